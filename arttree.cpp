@@ -0,0 +1,425 @@
+#include "arttree.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/** ===========================================================================
+    Constructors/ Destructors
+---------------------------------------------------------------------------- */
+ArtTree::ArtTree() {}
+
+ArtTree::~ArtTree() {
+    makeEmpty();
+}
+
+/** ===========================================================================
+    Operator Overrides
+---------------------------------------------------------------------------- */
+ostream& operator<<(ostream& out, const ArtTree& at) {
+    BufferedWriter w(out);
+    if (at.isEmpty()) {
+        w.write("! -- tree is empty -- !\n");
+    } else {
+        at.inorder(w);
+        w.put('\n');
+    }
+    w.flush();
+    return out;
+}
+
+void ArtTree::inorder(ostream& out) const {
+    BufferedWriter w(out);
+    inorderHelper(root, w);
+}
+
+void ArtTree::inorder(BufferedWriter& out) const {
+    inorderHelper(root, out);
+}
+
+void ArtTree::inorderHelper(Child c, BufferedWriter& out) const {
+    if (c == 0) return;
+
+    if (isLeaf(c)) {
+        out.write(leafOf(c)->getData());
+        out.put(' ');
+        return;
+    }
+    // a key ending here is a prefix of, so sorts before, all below.
+    const Inner* n = innerOf(c);
+    if (n->here != nullptr) {
+        out.write(n->here->getData());
+        out.put(' ');
+    }
+    int cursor = 0;
+    for (Child ch = nextChild(n, cursor); ch != 0; ch = nextChild(n, cursor)) {
+        inorderHelper(ch, out);
+    }
+}
+
+/** ===========================================================================
+    ArtTree Functions
+---------------------------------------------------------------------------- */
+bool ArtTree::isEmpty() const {
+    return root == 0;
+}
+
+int ArtTree::size() const {
+    return count;
+}
+
+void ArtTree::makeEmpty() {
+    deleteData(root);
+    root = 0;
+    count = 0;
+    // Nodes own nothing once the NodeData are gone.
+    pool4.clear();
+    pool16.clear();
+    pool48.clear();
+    pool256.clear();
+}
+
+void ArtTree::deleteData(Child c) {
+    if (c == 0) return;
+
+    if (isLeaf(c)) {
+        delete leafOf(c);
+        return;
+    }
+    const Inner* n = innerOf(c);
+    delete n->here;
+    int cursor = 0;
+    for (Child ch = nextChild(n, cursor); ch != 0; ch = nextChild(n, cursor)) {
+        deleteData(ch);
+    }
+}
+
+bool ArtTree::insert(NodeData* nd) {
+    if (nd == nullptr) return false;
+
+    if (!insert(root, nd, nd->getData(), 0)) {
+        return false;
+    }
+    ++count;
+    return true;
+}
+
+bool ArtTree::insert(Child& ref, NodeData* nd, string_view key,
+                     size_t depth) {
+    if (ref == 0) {
+        ref = leafChild(nd);
+        return true;
+    }
+
+    if (isLeaf(ref)) {
+        // two keys now share this slot: a new Node holds what they share.
+        NodeData* old = leafOf(ref);
+        string_view oldKey = old->getData();
+        size_t p = depth;
+        while (p < oldKey.size() && p < key.size() && oldKey[p] == key[p]) {
+            p++;
+        }
+        if (p == oldKey.size() && p == key.size()) {
+            return false;
+        }
+        Node4* n = pool4.allocate();
+        setPrefix(n, key.data() + depth, p - depth);
+        ref = innerChild(n);
+        place(ref, old, oldKey, p);
+        place(ref, nd, key, p);
+        return true;
+    }
+
+    Inner* n = innerOf(ref);
+    if (n->prefixLen > 0) {
+        size_t m = matchPrefix(n, key, depth);
+        if (m < n->prefixLen) {
+            // the key leaves n's prefix part way: split the prefix there.
+            string_view full; // holds all of n's prefix, past what n stores
+            if (n->prefixLen > MAX_PREFIX) {
+                full = minimum(ref)->getData();
+            }
+            uint8_t b = (m < MAX_PREFIX) ? n->prefix[m] : full[depth + m];
+            Node4* top = pool4.allocate();
+            setPrefix(top, key.data() + depth, m);
+
+            // n keeps what follows the byte it now hangs from.
+            size_t rest = n->prefixLen - m - 1;
+            if (n->prefixLen <= MAX_PREFIX) {
+                memmove(n->prefix, n->prefix + m + 1, rest);
+                n->prefixLen = rest;
+            } else {
+                setPrefix(n, full.data() + depth + m + 1, rest);
+            }
+            Child topRef = innerChild(top);
+            addChild(topRef, b, ref);
+            place(topRef, nd, key, depth + m);
+            ref = topRef;
+            return true;
+        }
+        depth += n->prefixLen;
+    }
+
+    if (depth == key.size()) {
+        // the prefix matched in full, so a key here is this key.
+        if (n->here != nullptr) {
+            return false;
+        }
+        n->here = nd;
+        return true;
+    }
+    Child* next = findChild(n, static_cast<uint8_t>(key[depth]));
+    if (next != nullptr) {
+        return insert(*next, nd, key, depth + 1);
+    }
+    addChild(ref, static_cast<uint8_t>(key[depth]), leafChild(nd));
+    return true;
+}
+
+void ArtTree::place(Child& ref, NodeData* nd, string_view key, size_t depth) {
+    if (depth == key.size()) {
+        innerOf(ref)->here = nd;
+    } else {
+        addChild(ref, static_cast<uint8_t>(key[depth]), leafChild(nd));
+    }
+}
+
+bool ArtTree::retrieve(const NodeData& target, NodeData*& ret) const {
+    return retrieve(string_view(target.getData()), ret);
+}
+
+bool ArtTree::retrieve(string_view key, NodeData*& ret) const {
+    Child c = root;
+    size_t depth = 0;
+    while (c != 0) {
+        if (isLeaf(c)) {
+            NodeData* nd = leafOf(c);
+            if (nd->compare(key) == 0) {
+                ret = nd;
+                return true;
+            }
+            break;
+        }
+        Inner* n = innerOf(c);
+        if (n->prefixLen > 0) {
+            // every key below is longer than the prefix.
+            if (key.size() - depth < n->prefixLen) break;
+
+            // bytes past those stored are checked against the key found.
+            size_t stored = min<size_t>(n->prefixLen, MAX_PREFIX);
+            if (memcmp(n->prefix, key.data() + depth, stored) != 0) break;
+            depth += n->prefixLen;
+        }
+        if (depth == key.size()) {
+            if (n->here != nullptr && n->here->compare(key) == 0) {
+                ret = n->here;
+                return true;
+            }
+            break;
+        }
+        Child* next = findChild(n, static_cast<uint8_t>(key[depth]));
+        if (next == nullptr) break;
+        c = *next;
+        depth++;
+    }
+    ret = nullptr;
+    return false;
+}
+
+ArtTree::Child* ArtTree::findChild(Inner* n, uint8_t b) {
+    switch (n->kind) {
+    case NODE4: {
+        Node4* n4 = static_cast<Node4*>(n);
+        for (int i = 0; i < n4->count; i++) {
+            if (n4->keys[i] == b) return &n4->child[i];
+        }
+        return nullptr;
+    }
+    case NODE16: {
+        Node16* n16 = static_cast<Node16*>(n);
+#if defined(__SSE2__)
+        // all 16 bytes in one compare; slots past count are masked off.
+        __m128i eq = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(b)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(n16->keys)));
+        int mask = _mm_movemask_epi8(eq) & ((1 << n16->count) - 1);
+        return (mask != 0) ? &n16->child[__builtin_ctz(mask)] : nullptr;
+#else
+        for (int i = 0; i < n16->count; i++) {
+            if (n16->keys[i] == b) return &n16->child[i];
+        }
+        return nullptr;
+#endif
+    }
+    case NODE48: {
+        Node48* n48 = static_cast<Node48*>(n);
+        int slot = n48->index[b];
+        return (slot != 0) ? &n48->child[slot - 1] : nullptr;
+    }
+    case NODE256: {
+        Node256* n256 = static_cast<Node256*>(n);
+        return (n256->child[b] != 0) ? &n256->child[b] : nullptr;
+    }
+    }
+    return nullptr;
+}
+
+ArtTree::Child ArtTree::nextChild(const Inner* n, int& cursor) {
+    switch (n->kind) {
+    case NODE4: {
+        const Node4* n4 = static_cast<const Node4*>(n);
+        return (cursor < n4->count) ? n4->child[cursor++] : 0;
+    }
+    case NODE16: {
+        const Node16* n16 = static_cast<const Node16*>(n);
+        return (cursor < n16->count) ? n16->child[cursor++] : 0;
+    }
+    case NODE48: {
+        const Node48* n48 = static_cast<const Node48*>(n);
+        while (cursor < 256) {
+            int slot = n48->index[cursor++];
+            if (slot != 0) return n48->child[slot - 1];
+        }
+        return 0;
+    }
+    case NODE256: {
+        const Node256* n256 = static_cast<const Node256*>(n);
+        while (cursor < 256) {
+            Child c = n256->child[cursor++];
+            if (c != 0) return c;
+        }
+        return 0;
+    }
+    }
+    return 0;
+}
+
+const NodeData* ArtTree::minimum(Child c) {
+    while (!isLeaf(c)) {
+        const Inner* n = innerOf(c);
+        if (n->here != nullptr) {
+            return n->here;
+        }
+        int cursor = 0;
+        c = nextChild(n, cursor);
+    }
+    return leafOf(c);
+}
+
+size_t ArtTree::matchPrefix(const Inner* n, string_view key, size_t depth) {
+    size_t limit = min<size_t>(n->prefixLen, key.size() - depth);
+    size_t stored = min<size_t>(limit, MAX_PREFIX);
+    size_t i = 0;
+    while (i < stored && n->prefix[i] == static_cast<uint8_t>(key[depth + i])) {
+        i++;
+    }
+    if (i < stored || i == limit) {
+        return i;
+    }
+    // the rest of the prefix is only in the keys below n.
+    string_view full = minimum(innerChild(const_cast<Inner*>(n)))->getData();
+    while (i < limit && full[depth + i] == key[depth + i]) {
+        i++;
+    }
+    return i;
+}
+
+void ArtTree::setPrefix(Inner* n, const char* bytes, size_t len) {
+    n->prefixLen = static_cast<uint32_t>(len);
+    memcpy(n->prefix, bytes, min<size_t>(len, MAX_PREFIX));
+}
+
+void ArtTree::addChild(Child& ref, uint8_t b, Child c) {
+    Inner* n = innerOf(ref);
+    int capacity = (n->kind == NODE4) ? 4 : (n->kind == NODE16) ? 16
+                 : (n->kind == NODE48) ? 48 : 256;
+    if (n->count == capacity) {
+        grow(ref);
+        n = innerOf(ref);
+    }
+
+    uint8_t* keys = nullptr;
+    Child* child = nullptr;
+    switch (n->kind) {
+    case NODE4:
+        keys = static_cast<Node4*>(n)->keys;
+        child = static_cast<Node4*>(n)->child;
+        break;
+    case NODE16:
+        keys = static_cast<Node16*>(n)->keys;
+        child = static_cast<Node16*>(n)->child;
+        break;
+    case NODE48: {
+        // no removals, so the slots in use are always the first count.
+        Node48* n48 = static_cast<Node48*>(n);
+        n48->child[n48->count] = c;
+        n48->index[b] = static_cast<uint8_t>(++n48->count);
+        return;
+    }
+    case NODE256:
+        static_cast<Node256*>(n)->child[b] = c;
+        n->count++;
+        return;
+    }
+
+    // keep the bytes sorted, so children come out in order.
+    int i = n->count;
+    while (i > 0 && keys[i - 1] > b) {
+        keys[i] = keys[i - 1];
+        child[i] = child[i - 1];
+        i--;
+    }
+    keys[i] = b;
+    child[i] = c;
+    n->count++;
+}
+
+void ArtTree::grow(Child& ref) {
+    Inner* n = innerOf(ref);
+    Inner* bigger = nullptr;
+    switch (n->kind) {
+    case NODE4: {
+        Node4* n4 = static_cast<Node4*>(n);
+        Node16* n16 = pool16.allocate();
+        memcpy(n16->keys, n4->keys, n4->count);
+        copy(n4->child, n4->child + n4->count, n16->child);
+        bigger = n16;
+        break;
+    }
+    case NODE16: {
+        Node16* n16 = static_cast<Node16*>(n);
+        Node48* n48 = pool48.allocate();
+        for (int i = 0; i < n16->count; i++) {
+            n48->index[n16->keys[i]] = static_cast<uint8_t>(i + 1);
+            n48->child[i] = n16->child[i];
+        }
+        bigger = n48;
+        break;
+    }
+    case NODE48: {
+        Node48* n48 = static_cast<Node48*>(n);
+        Node256* n256 = pool256.allocate();
+        for (int b = 0; b < 256; b++) {
+            if (n48->index[b] != 0) {
+                n256->child[b] = n48->child[n48->index[b] - 1];
+            }
+        }
+        bigger = n256;
+        break;
+    }
+    case NODE256:
+        return; // a Node256 has room for every byte
+    }
+
+    bigger->count = n->count;
+    bigger->prefixLen = n->prefixLen;
+    memcpy(bigger->prefix, n->prefix, MAX_PREFIX);
+    bigger->here = n->here;
+    switch (n->kind) {
+    case NODE4: pool4.release(static_cast<Node4*>(n)); break;
+    case NODE16: pool16.release(static_cast<Node16*>(n)); break;
+    case NODE48: pool48.release(static_cast<Node48*>(n)); break;
+    case NODE256: break;
+    }
+    ref = innerChild(bigger);
+}
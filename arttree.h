@@ -0,0 +1,273 @@
+/** ===========================================================================
+    arttree.h
+    Purpose: implement an adaptive radix tree (ART) of NodeData, keyed by
+    the bytes of their strings.
+
+    Each level consumes one byte of the key, so a lookup costs O(key length)
+    however many keys the tree holds, and compares no byte twice. Inner
+    Nodes come in four sizes (4, 16, 48 and 256 children) and grow as
+    children are added, and a chain of single-child Nodes is compressed
+    into a prefix stored in the Node below it, so long shared prefixes cost
+    one step rather than one per byte. Leaves are the NodeData* themselves,
+    tagged in their parent's child slot, so a key costs its NodeData plus a
+    share of an inner Node rather than a whole BinTree Node.
+
+    Assumptions:
+    Duplicate data is ignored when inserting into a tree.
+    Keys are compared as unsigned bytes, shorter first on a tie, which is
+    also how NodeData orders them, so inorder lists them in NodeData order.
+    A key that is a prefix of others is kept in the inner Node where it
+    ends, so no terminator byte is needed and keys may hold any byte.
+    This class does not implement functions to remove individual NodeData.
+
+    @author: Charlie Nguyen
+    @version: 1.0
+---------------------------------------------------------------------------- */
+#ifndef ARTTREE_H
+#define ARTTREE_H
+
+#include "bufferedwriter.h"
+#include "nodedata.h"
+#include "nodepool.h"
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+using namespace std;
+
+class ArtTree
+{
+    // operator<< method can access ArtTree class' private properties
+    friend ostream& operator<<(ostream& out, const ArtTree& at);
+public:
+    /** =======================================================================
+        Default constructor.
+        -------------------------------------------------------------------- */
+    ArtTree();
+
+    /** =======================================================================
+        Destructor.
+        -------------------------------------------------------------------- */
+    ~ArtTree();
+
+    // Copying is not supported.
+    ArtTree(const ArtTree&) = delete;
+    ArtTree& operator=(const ArtTree&) = delete;
+
+    /** =======================================================================
+        Checks to see if the tree is empty.
+
+        @return true if empty, false otherwise.
+        -------------------------------------------------------------------- */
+    bool isEmpty() const;
+
+    /** =======================================================================
+        @return the number of NodeData in the tree.
+        -------------------------------------------------------------------- */
+    int size() const;
+
+    /** =======================================================================
+        Deletes every NodeData and returns every Node to the pools, leaving
+        the tree empty.
+        -------------------------------------------------------------------- */
+    void makeEmpty();
+
+    /** =======================================================================
+        Inserts a NodeData, ignoring duplicates. The tree takes ownership of
+        nd if it is inserted; the caller keeps it otherwise.
+
+        @param nd The NodeData to be inserted.
+        @return true if inserted, false if nullptr or already present.
+        -------------------------------------------------------------------- */
+    bool insert(NodeData* nd);
+
+    /** =======================================================================
+        Finds the NodeData in the tree matching the target.
+
+        @param target The NodeData object to search for in the tree.
+        @param ret The NodeData in the tree if found, nullptr otherwise.
+        @return true if found, false otherwise.
+        -------------------------------------------------------------------- */
+    bool retrieve(const NodeData& target, NodeData*& ret) const;
+
+    /** =======================================================================
+        Finds the NodeData in the tree whose data matches a raw key, without
+        building a NodeData to compare against.
+
+        @param key The data to search for.
+        @param ret The NodeData in the tree if found, nullptr otherwise.
+        @return true if found, false otherwise.
+        -------------------------------------------------------------------- */
+    bool retrieve(string_view key, NodeData*& ret) const;
+
+    /** =======================================================================
+        Prints the NodeData in ascending order, each followed by a space.
+
+        @param out The stream to be printed on.
+        -------------------------------------------------------------------- */
+    void inorder(ostream& out) const;
+
+    /** =======================================================================
+        inorder through a caller's writer, in bounded memory.
+
+        @param out The writer to print with. Not flushed.
+        -------------------------------------------------------------------- */
+    void inorder(BufferedWriter& out) const;
+
+private:
+    static const int MAX_PREFIX = 8; // prefix bytes kept in a Node
+
+    // A child slot: an Inner* or, with the low bit set, a leaf's NodeData*.
+    // 0 is an empty slot.
+    typedef uintptr_t Child;
+
+    enum Kind : uint8_t { NODE4, NODE16, NODE48, NODE256 };
+
+    // Fields every inner Node has.
+    struct Inner {
+        Kind kind;
+        uint16_t count = 0;          // children in use
+        uint32_t prefixLen = 0;      // bytes all keys below share from here
+        uint8_t prefix[MAX_PREFIX];  // the first MAX_PREFIX of them
+        NodeData* here = nullptr;    // the key ending at this Node, if any
+        explicit Inner(Kind k) : kind(k) {}
+    };
+
+    struct Node4 : Inner {
+        uint8_t keys[4];             // sorted bytes of the children
+        Child child[4] = {};
+        Node4() : Inner(NODE4) {}
+    };
+
+    struct Node16 : Inner {
+        uint8_t keys[16];            // sorted bytes of the children
+        Child child[16] = {};
+        Node16() : Inner(NODE16) {}
+    };
+
+    struct Node48 : Inner {
+        uint8_t index[256] = {};     // 1 + slot of each byte's child, or 0
+        Child child[48] = {};        // filled in order of arrival
+        Node48() : Inner(NODE48) {}
+    };
+
+    struct Node256 : Inner {
+        Child child[256] = {};       // indexed by byte
+        Node256() : Inner(NODE256) {}
+    };
+
+    Child root = 0;            // Root of the entire ArtTree
+    int count = 0;             // number of NodeData in the tree
+    NodePool<Node4> pool4;     // storage for each size of Node
+    NodePool<Node16> pool16;
+    NodePool<Node48> pool48;
+    NodePool<Node256> pool256;
+
+    static bool isLeaf(Child c) { return (c & 1) != 0; }
+    static NodeData* leafOf(Child c) {
+        return reinterpret_cast<NodeData*>(c & ~uintptr_t(1));
+    }
+    static Inner* innerOf(Child c) { return reinterpret_cast<Inner*>(c); }
+    static Child leafChild(NodeData* nd) {
+        return reinterpret_cast<uintptr_t>(nd) | 1;
+    }
+    static Child innerChild(Inner* n) { return reinterpret_cast<uintptr_t>(n); }
+
+    /** =======================================================================
+        Finds the child slot for a byte.
+
+        @param n The Node to search.
+        @param b The next byte of the key.
+        @return the slot, nullptr if n has no child for b.
+        -------------------------------------------------------------------- */
+    static Child* findChild(Inner* n, uint8_t b);
+
+    /** =======================================================================
+        Steps through a Node's children in ascending byte order.
+
+        @param n The Node.
+        @param cursor Where to continue from; 0 to start. Advanced past the
+                      child returned.
+        @return the next child, 0 when there are no more.
+        -------------------------------------------------------------------- */
+    static Child nextChild(const Inner* n, int& cursor);
+
+    /** =======================================================================
+        @param c The root of a subtree. Must not be empty.
+        @return the smallest NodeData in the subtree.
+        -------------------------------------------------------------------- */
+    static const NodeData* minimum(Child c);
+
+    /** =======================================================================
+        Counts how many bytes of a Node's prefix the key matches, checking
+        bytes beyond those stored in the Node against a key below it.
+
+        @param n The Node.
+        @param key The key.
+        @param depth Where n's prefix starts in the key.
+        @return the length of the match, n->prefixLen if it all matches.
+        -------------------------------------------------------------------- */
+    static size_t matchPrefix(const Inner* n, string_view key, size_t depth);
+
+    /** =======================================================================
+        Sets a Node's prefix.
+
+        @param n The Node.
+        @param bytes The prefix.
+        @param len Its length.
+        -------------------------------------------------------------------- */
+    static void setPrefix(Inner* n, const char* bytes, size_t len);
+
+    /** =======================================================================
+        Recursively inserts a NodeData, ignoring duplicates.
+
+        @param ref The slot of the subtree, updated if its root changes.
+        @param nd The NodeData to be inserted.
+        @param key nd's data.
+        @param depth How many bytes of key the levels above consumed.
+        @return true if inserted, false if already present.
+        -------------------------------------------------------------------- */
+    bool insert(Child& ref, NodeData* nd, string_view key, size_t depth);
+
+    /** =======================================================================
+        Hangs a NodeData off an inner Node whose prefix it matches: in the
+        Node itself if its key ends there, as a leaf child otherwise.
+
+        @param ref The slot of the Node, updated if the Node grows.
+        @param nd The NodeData.
+        @param key nd's data.
+        @param depth Where the key continues after the Node's prefix.
+        -------------------------------------------------------------------- */
+    void place(Child& ref, NodeData* nd, string_view key, size_t depth);
+
+    /** =======================================================================
+        Adds a child to an inner Node, growing it first if it is full.
+
+        @param ref The slot of the Node, updated if the Node grows.
+        @param b The byte the child is reached by. n must not have one.
+        @param c The child.
+        -------------------------------------------------------------------- */
+    void addChild(Child& ref, uint8_t b, Child c);
+
+    /** =======================================================================
+        Moves a full Node's contents to a Node of the next size up.
+
+        @param ref The slot of the Node, updated to the new Node.
+        -------------------------------------------------------------------- */
+    void grow(Child& ref);
+
+    /** =======================================================================
+        Deletes every NodeData in a subtree. The Nodes are left to the pools.
+
+        @param c The root of the subtree.
+        -------------------------------------------------------------------- */
+    void deleteData(Child c);
+
+    /** =======================================================================
+        Helper method that recursively prints a subtree in ascending order.
+
+        @param c The root of the subtree.
+        @param out The writer to print the tree with.
+        -------------------------------------------------------------------- */
+    void inorderHelper(Child c, BufferedWriter& out) const;
+};
+#endif
@@ -0,0 +1,922 @@
+/** ===========================================================================
+    benchmark.cpp
+    Purpose: measures the tree engines' operations on large key sets.
+
+    Builds a BinTree, a KeyTree<int64_t> and a WideTree from the same random
+    64-bit keys and times retrieve on a mix of present and absent keys.
+    BinTree keys are the decimal spelling of each integer. Then times the
+    BinTree's lock-free retrieve in concurrent mode for 1, 2, 4, ... threads
+    up to the number of hardware threads, and concurrent insert for 1, 2, 4,
+    ... threads (at least 4). Each insert run doubles as a stress test: the
+    threads' key ranges overlap so they race on duplicates, and the result
+    is checked against the keys inserted. A failed check exits with 1.
+
+    The suite mode instead runs every BinTree operation (plus KeyTree,
+    WideTree and ArtTree insert/retrieve) on sorted, reverse, random,
+    Zipf-skewed, hot-set (90% of draws from 1% of the keys) and
+    duplicate-heavy key streams of 10^3, 10^4, ... keys up to maxKeys. Each
+    line gives the time and heap allocations per operation (per element for
+    whole-tree operations), and each size ends with the peak RSS so far. The
+    BinTree is AVL balanced throughout, since an unbalanced tree degrades to
+    a list on sorted input; BinTree/splay rows repeat its insert and
+    retrieve in splay mode, after which the splayed tree must equal its copy
+    and its save and load round trip (else exit with 1), and BinTree/indexed
+    rows time building its hash index and retrieving through it. Each size
+    also writes a file of that many keys in data2.txt's format and times
+    building its trees with ifstream >> and with ingestTree over a
+    memory-mapped copy. Both must build the same trees, on that file and on
+    data2.txt; a mismatch exits with 1. Last, deep rows build a splay tree
+    from that many ascending keys, which leaves it a path, and run every
+    operation that walks a whole tree or one path on it; a wrong answer
+    exits with 1.
+
+    Usage: benchmark [keys] [lookups]
+           benchmark suite [maxKeys]      (default 10^6; 10^7 takes minutes)
+
+    @author: Charlie Nguyen
+    @version: 1.0
+---------------------------------------------------------------------------- */
+#include "arttree.h"
+#include "bintree.h"
+#include "ingest.h"
+#include "keytree.h"
+#include "mappedfile.h"
+#include "widetree.h"
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// every heap allocation in the process, counted by operator new below.
+static atomic<long> allocations(0);
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size != 0 ? size : 1)) {
+        return p;
+    }
+    throw bad_alloc();
+}
+
+// gcc takes the free() below for a mismatch with the operator new above.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// the key streams the suite runs on.
+enum Workload { SORTED, REVERSE, RANDOM, ZIPF, HOTSET, DUPLICATES };
+static const char* const WORKLOAD_NAMES[] = {
+    "sorted", "reverse", "random", "zipf", "hot-set", "dup-heavy"
+};
+
+//global function prototypes
+bool stressInsert(const vector<string>& keys, int threads, int distinct);
+double nsPerOp(chrono::steady_clock::time_point start, int ops);
+void report(const string& engine, const string& op, double ns, long found);
+int runSuite(int maxKeys);
+bool runWorkload(Workload w, int n);
+bool runIngest(int n);
+bool runDeep(int n);
+bool sameSaved(const BinTree& bt);
+long streamTrees(const string& path, deque<BinTree>& trees);
+long mappedTrees(const string& path, deque<BinTree>& trees);
+bool sameTrees(const deque<BinTree>& a, const deque<BinTree>& b);
+vector<int64_t> makeStream(Workload w, int n, mt19937_64& rng);
+string spell(int64_t v);
+void timed(const string& engine, const string& op, int ops,
+           const function<long()>& body);
+long peakRssKB();
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "suite") == 0) {
+        return runSuite((argc > 2) ? atoi(argv[2]) : 1000000);
+    }
+    int n = (argc > 1) ? atoi(argv[1]) : 1000000;
+    int lookups = (argc > 2) ? atoi(argv[2]) : 1000000;
+
+    // keys to insert, and probes of which about half are present.
+    mt19937_64 rng(12345);
+    vector<int64_t> keys(n);
+    for (int64_t& k : keys) {
+        k = static_cast<int64_t>(rng() >> 1);
+    }
+    vector<int64_t> probes(lookups);
+    for (int64_t& p : probes) {
+        p = (rng() & 1) ? keys[rng() % n] : static_cast<int64_t>(rng() >> 1);
+    }
+    vector<NodeData> probeND;
+    probeND.reserve(lookups);
+    for (int64_t p : probes) {
+        probeND.push_back(NodeData(to_string(p)));
+    }
+    cout << "keys: " << n << "  lookups: " << lookups << endl;
+
+    // BinTree, balanced so sorted runs don't skew the comparison.
+    BinTree bt;
+    bt.setBalance(BinTree::AVL);
+    auto start = chrono::steady_clock::now();
+    for (int64_t k : keys) {
+        NodeData* nd = new NodeData(to_string(k));
+        if (!bt.insert(nd)) delete nd;
+    }
+    report("BinTree", "insert", nsPerOp(start, n), n);
+    long found = 0;
+    start = chrono::steady_clock::now();
+    for (const NodeData& p : probeND) {
+        NodeData* ret;
+        found += bt.retrieve(p, ret);
+    }
+    report("BinTree", "retrieve", nsPerOp(start, lookups), found);
+
+    KeyTree<int64_t> kt;
+    start = chrono::steady_clock::now();
+    for (int64_t k : keys) {
+        kt.insert(k);
+    }
+    report("KeyTree", "insert", nsPerOp(start, n), kt.size());
+    found = 0;
+    start = chrono::steady_clock::now();
+    for (int64_t p : probes) {
+        found += kt.contains(p);
+    }
+    report("KeyTree", "retrieve", nsPerOp(start, lookups), found);
+
+    WideTree wt;
+    start = chrono::steady_clock::now();
+    for (int64_t k : keys) {
+        wt.insert(k);
+    }
+    report("WideTree", "insert", nsPerOp(start, n), wt.size());
+    found = 0;
+    start = chrono::steady_clock::now();
+    for (int64_t p : probes) {
+        found += wt.retrieve(p);
+    }
+    report("WideTree", "retrieve", nsPerOp(start, lookups), found);
+    cout << "WideTree height: " << wt.height() << endl;
+
+    // lock-free readers: aggregate throughput as threads are added.
+    bt.setConcurrent(true);
+    int cores = static_cast<int>(thread::hardware_concurrency());
+    for (int threads = 1; threads <= max(cores, 1); threads *= 2) {
+        vector<thread> readers;
+        vector<long> hits(threads, 0);
+        start = chrono::steady_clock::now();
+        for (int t = 0; t < threads; t++) {
+            readers.emplace_back([&bt, &probeND, &hits, t] {
+                long h = 0; // local, so threads don't share a cache line
+                for (const NodeData& p : probeND) {
+                    NodeData* ret;
+                    h += bt.retrieve(p, ret);
+                }
+                hits[t] = h;
+            });
+        }
+        found = 0;
+        for (int t = 0; t < threads; t++) {
+            readers[t].join();
+            found += hits[t];
+        }
+        report("BinTree x" + to_string(threads), "concurrent retrieve",
+               nsPerOp(start, lookups * threads), found);
+    }
+
+    // many writers into one unbalanced tree.
+    vector<string> spelled;
+    spelled.reserve(n);
+    for (int64_t k : keys) {
+        spelled.push_back(to_string(k));
+    }
+    for (int threads = 1; threads <= max(cores, 4); threads *= 2) {
+        if (!stressInsert(spelled, threads, kt.size())) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/** ===========================================================================
+    Inserts keys into one concurrent BinTree from several threads at once.
+    Thread t inserts slices t and t+1 of the keys, so every key is offered
+    twice by different threads and exactly one of them must win. Reports
+    the throughput, then checks the tree holds each distinct key once, in
+    order.
+---------------------------------------------------------------------------- */
+bool stressInsert(const vector<string>& keys, int threads, int distinct) {
+    BinTree bt;
+    bt.setConcurrent(true);
+    int n = static_cast<int>(keys.size());
+    vector<int> wins(threads, 0);
+    vector<thread> writers;
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        writers.emplace_back([&bt, &keys, &wins, n, threads, t] {
+            int won = 0;
+            for (int s = t; s <= t + 1; s++) {
+                int lo = static_cast<int>(static_cast<long>(n) *
+                                          (s % threads) / threads);
+                int hi = static_cast<int>(static_cast<long>(n) *
+                                          (s % threads + 1) / threads);
+                for (int i = lo; i < hi; i++) {
+                    NodeData* nd = new NodeData(keys[i]);
+                    if (bt.insert(nd)) {
+                        won++;
+                    } else {
+                        delete nd; // duplicate, caller keeps ownership
+                    }
+                }
+            }
+            wins[t] = won;
+        });
+    }
+    int inserted = 0;
+    for (int t = 0; t < threads; t++) {
+        writers[t].join();
+        inserted += wins[t];
+    }
+    report("BinTree x" + to_string(threads), "concurrent insert",
+           nsPerOp(start, 2 * n), inserted);
+
+    // every key present once, in order, and nothing else.
+    int seen = 0;
+    const NodeData* prev = nullptr;
+    for (const NodeData& nd : bt) {
+        if (prev != nullptr && !(*prev < nd)) {
+            cout << "FAILED: tree out of order" << endl;
+            return false;
+        }
+        prev = &nd;
+        seen++;
+    }
+    for (const string& k : keys) {
+        NodeData* ret;
+        if (!bt.retrieve(NodeData(k), ret)) {
+            cout << "FAILED: lost key " << k << endl;
+            return false;
+        }
+    }
+    if (inserted != distinct || seen != distinct || bt.size() != distinct) {
+        cout << "FAILED: " << inserted << " inserted, " << seen
+             << " in tree (size " << bt.size() << "), expected " << distinct
+             << endl;
+        return false;
+    }
+    return true;
+}
+
+/** ===========================================================================
+    Runs every workload at 10^3, 10^4, ... keys, up to maxKeys.
+---------------------------------------------------------------------------- */
+int runSuite(int maxKeys) {
+    // the sample data must come out the same through either reader.
+    deque<BinTree> streamed, mapped;
+    if (streamTrees("data2.txt", streamed) < 0 ||
+        mappedTrees("data2.txt", mapped) < 0) {
+        cout << "data2.txt not found; skipping its ingest check" << endl;
+    } else if (!sameTrees(streamed, mapped)) {
+        cout << "FAILED: ingestTree built different trees from data2.txt"
+             << endl;
+        return 1;
+    }
+
+    cout << "workload\tkeys\tengine\top\tns/op\tallocs/op\tfound" << endl;
+    for (long n = 1000; n <= maxKeys; n *= 10) {
+        for (Workload w : {SORTED, REVERSE, RANDOM, ZIPF, HOTSET,
+                           DUPLICATES}) {
+            if (!runWorkload(w, static_cast<int>(n))) {
+                return 1;
+            }
+        }
+        if (!runIngest(static_cast<int>(n)) ||
+            !runDeep(static_cast<int>(n))) {
+            return 1;
+        }
+        cout << "peak RSS after " << n << " keys: " << peakRssKB() / 1024
+             << " MB" << endl;
+    }
+    return 0;
+}
+
+/** ===========================================================================
+    Times each operation on one key stream of n keys. Lookups use a second
+    stream drawn the same way, so they hit and miss in the same proportion
+    an application with that key distribution would see. Returns false if
+    the splayed tree does not survive a copy or a save and load intact.
+---------------------------------------------------------------------------- */
+bool runWorkload(Workload w, int n) {
+    mt19937_64 rng(12345 + w);
+    vector<int64_t> keys = makeStream(w, n, rng);
+    vector<int64_t> probes = makeStream(w, n, rng);
+    vector<NodeData> probeND;
+    probeND.reserve(n);
+    for (int64_t p : probes) {
+        probeND.push_back(NodeData(spell(p)));
+    }
+    auto row = [w, n](const string& engine, const string& op, int ops,
+                      const function<long()>& body) {
+        cout << WORKLOAD_NAMES[w] << "\t" << n << "\t";
+        timed(engine, op, ops, body);
+    };
+
+    BinTree bt;
+    bt.setBalance(BinTree::AVL);
+    row("BinTree", "insert", n, [&] {
+        long inserted = 0;
+        for (int64_t k : keys) {
+            NodeData* nd = new NodeData(spell(k));
+            if (bt.insert(nd)) {
+                inserted++;
+            } else {
+                delete nd;
+            }
+        }
+        return inserted;
+    });
+    row("BinTree", "retrieve", n, [&] {
+        long found = 0;
+        for (const NodeData& p : probeND) {
+            NodeData* ret;
+            found += bt.retrieve(p, ret);
+        }
+        return found;
+    });
+    vector<const NodeData*> probePtrs(n);
+    vector<NodeData*> results(n);
+    for (int i = 0; i < n; i++) {
+        probePtrs[i] = &probeND[i];
+    }
+    row("BinTree", "retrieveBatch", n, [&] {
+        return static_cast<long>(bt.retrieveBatch(probePtrs.data(), n,
+                                                  results.data()));
+    });
+    row("BinTree", "getDepth", n, [&] {
+        long depths = 0;
+        for (const NodeData& p : probeND) {
+            depths += bt.getDepth(p, true);
+        }
+        return depths;
+    });
+    row("BinTree/indexed", "setIndexed", bt.size(), [&] {
+        bt.setIndexed(true);
+        return static_cast<long>(bt.size());
+    });
+    row("BinTree/indexed", "retrieve", n, [&] {
+        long found = 0;
+        for (const NodeData& p : probeND) {
+            NodeData* ret;
+            found += bt.retrieve(p, ret);
+        }
+        return found;
+    });
+    bt.setIndexed(false);
+
+    // whole-tree operations, timed per element.
+    int size = bt.size();
+    BinTree* fresh = nullptr;
+    row("BinTree", "copy", size, [&] {
+        fresh = new BinTree(bt);
+        return static_cast<long>(fresh->size());
+    });
+    delete fresh;
+    BinTree copy;
+    copy = bt;
+    row("BinTree", "operator=", size, [&] {
+        copy = bt; // same shape, so every Node is overwritten in place
+        return static_cast<long>(copy.size());
+    });
+    row("BinTree", "operator==", size, [&] {
+        return static_cast<long>(copy == bt);
+    });
+    vector<NodeData*> sorted;
+    sorted.reserve(size);
+    row("BinTree", "bstreeToArray", size, [&] {
+        copy.bstreeToArray(sorted);
+        return static_cast<long>(sorted.size());
+    });
+    row("BinTree", "arrayToBSTree", size, [&] {
+        copy.arrayToBSTree(sorted);
+        return static_cast<long>(copy.size());
+    });
+    row("BinTree", "makeEmpty", size, [&] {
+        copy.makeEmpty();
+        return static_cast<long>(copy.isEmpty());
+    });
+    copy = bt;
+    BinTree other;
+    other.setBalance(BinTree::AVL);
+    for (const NodeData& p : probeND) {
+        NodeData* nd = new NodeData(p);
+        if (!other.insert(nd)) delete nd;
+    }
+    int both = copy.size() + other.size();
+    row("BinTree", "unionWith", both, [&] {
+        copy.unionWith(other, 0);
+        return static_cast<long>(copy.size());
+    });
+    copy.makeEmpty();
+    bt.makeEmpty();
+
+    vector<NodeData*> batch(n);
+    row("BinTree", "insertBatch", n, [&] {
+        for (int i = 0; i < n; i++) {
+            batch[i] = new NodeData(spell(keys[i]));
+        }
+        bool* inserted = new bool[n];
+        long count = bt.insertBatch(batch.data(), n, inserted);
+        for (int i = 0; i < n; i++) {
+            if (!inserted[i]) delete batch[i];
+        }
+        delete[] inserted;
+        return count;
+    });
+    bt.makeEmpty();
+
+    KeyTree<> kt;
+    row("KeyTree", "insert", n, [&] {
+        for (int64_t k : keys) {
+            kt.insert(NodeData(spell(k)));
+        }
+        return static_cast<long>(kt.size());
+    });
+    row("KeyTree", "retrieve", n, [&] {
+        long found = 0;
+        for (const NodeData& p : probeND) {
+            found += kt.contains(p);
+        }
+        return found;
+    });
+    kt.makeEmpty();
+
+    WideTree wt;
+    row("WideTree", "insert", n, [&] {
+        for (int64_t k : keys) {
+            wt.insert(k);
+        }
+        return static_cast<long>(wt.size());
+    });
+    row("WideTree", "retrieve", n, [&] {
+        long found = 0;
+        for (int64_t p : probes) {
+            found += wt.retrieve(p);
+        }
+        return found;
+    });
+
+    ArtTree at;
+    row("ArtTree", "insert", n, [&] {
+        long inserted = 0;
+        for (int64_t k : keys) {
+            NodeData* nd = new NodeData(spell(k));
+            if (at.insert(nd)) {
+                inserted++;
+            } else {
+                delete nd;
+            }
+        }
+        return inserted;
+    });
+    row("ArtTree", "retrieve", n, [&] {
+        long found = 0;
+        for (const NodeData& p : probeND) {
+            NodeData* ret;
+            found += at.retrieve(p, ret);
+        }
+        return found;
+    });
+    at.makeEmpty();
+
+    // the same lookups with hot keys moving to the top.
+    BinTree splay;
+    splay.setBalance(BinTree::SPLAY);
+    row("BinTree/splay", "insert", n, [&] {
+        long inserted = 0;
+        for (int64_t k : keys) {
+            NodeData* nd = new NodeData(spell(k));
+            if (splay.insert(nd)) {
+                inserted++;
+            } else {
+                delete nd;
+            }
+        }
+        return inserted;
+    });
+    row("BinTree/splay", "retrieve", n, [&] {
+        long found = 0;
+        for (const NodeData& p : probeND) {
+            NodeData* ret;
+            found += splay.retrieve(p, ret);
+        }
+        return found;
+    });
+    // a later splay can mend what an earlier one left stale, so check
+    // after each of a few. each check caches every subtree's hash first.
+    bool intact = sameSaved(splay);
+    for (int i = 0; intact && i < 4 && i < n; i++) {
+        NodeData* ret;
+        splay.retrieve(probeND[i], ret);
+        intact = sameSaved(splay);
+    }
+    if (!intact) {
+        cout << "FAILED: a splayed tree changed when copied or reloaded"
+             << endl;
+        return false;
+    }
+    splay.makeEmpty();
+    return true;
+}
+
+/** ===========================================================================
+    Writes n random keys (about a third of them repeats) to a temporary file
+    as trees of 1000 keys ended by "$$", like data2.txt, then times reading
+    it back into trees both ways. Returns false if the two disagree.
+---------------------------------------------------------------------------- */
+bool runIngest(int n) {
+    char path[] = "/tmp/bintree-ingest-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        cout << "can't create a temporary file; skipping ingest" << endl;
+        return true;
+    }
+    mt19937_64 rng(777);
+    {
+        BufferedWriter out(fd);
+        for (int i = 0; i < n; i++) {
+            out.write(spell(static_cast<int64_t>(rng() % 1000) * 7919));
+            out.put((i % 1000 == 999) ? '\n' : ' ');
+            if (i % 1000 == 999) {
+                out.write("$$\n");
+            }
+        }
+    }
+    close(fd);
+
+    auto row = [n](const string& engine, const string& op,
+                   const function<long()>& body) {
+        cout << "ingest\t" << n << "\t";
+        timed(engine, op, n, body);
+    };
+    deque<BinTree> streamed, mapped;
+    row("BinTree", "ifstream build", [&] {
+        return streamTrees(path, streamed);
+    });
+    row("BinTree", "mmap ingestTree", [&] {
+        return mappedTrees(path, mapped);
+    });
+    unlink(path);
+
+    if (!sameTrees(streamed, mapped)) {
+        cout << "FAILED: ingestTree built different trees" << endl;
+        return false;
+    }
+    return true;
+}
+
+/** ===========================================================================
+    Inserts n ascending keys into a splay tree, which leaves it a path n - 1
+    Nodes deep with the smallest key at the bottom, then runs every
+    operation that walks a whole tree or one path of it on that tree, on an
+    unbalanced copy and on one reloaded from a save. None may recurse once
+    per level, or the larger sizes overflow the stack. Times are per Node.
+    Returns false if any gives a wrong answer.
+---------------------------------------------------------------------------- */
+bool runDeep(int n) {
+    auto row = [n](const string& engine, const string& op,
+                   const function<long()>& body) {
+        cout << "deep\t" << n << "\t";
+        timed(engine, op, n, body);
+    };
+    ofstream sink("/dev/null");
+    bool ok = true;
+
+    // keys 2 to n + 1, so 0 and 1 can go in below all of them.
+    BinTree bt;
+    bt.setBalance(BinTree::SPLAY);
+    row("BinTree/splay", "insert", [&] {
+        long inserted = 0;
+        for (int i = 2; i < n + 2; i++) {
+            inserted += bt.insert(new NodeData(spell(i)));
+        }
+        return inserted;
+    });
+    int height = 0;
+    row("BinTree/splay", "stats", [&] {
+        height = bt.stats().height;
+        ok = ok && height >= n - 1;
+        return height;
+    });
+    row("BinTree/splay", "operator<<", [&] {
+        sink << bt;
+        return bt.size();
+    });
+    if (n <= 100000) {
+        // each line is indented by its depth, so the output grows as n^2.
+        row("BinTree/splay", "displaySideways", [&] {
+            BufferedWriter w(sink);
+            bt.displaySideways(w);
+            w.flush();
+            return bt.size();
+        });
+    }
+    row("BinTree/splay", "freeze", [&] {
+        int frozen = bt.freeze().size();
+        ok = ok && frozen == n;
+        return frozen;
+    });
+
+    // the copy stays a path, and without splaying every search walks it.
+    BinTree copy;
+    row("BinTree", "operator=", [&] {
+        copy = bt;
+        return copy.size();
+    });
+    copy.setBalance(BinTree::UNBALANCED);
+    row("BinTree", "==", [&] {
+        bool same = (copy == bt);
+        ok = ok && same;
+        return same;
+    });
+    row("BinTree", "erase deepest", [&] {
+        bool erased = copy.erase(NodeData(spell(2)));
+        ok = ok && erased;
+        return erased;
+    });
+    row("BinTree", "diff", [&] {
+        vector<NodeData*> out;
+        bt.diff(copy, out); // only the Node that lost its child differs
+        ok = ok && out.size() == 1 && *out[0] == NodeData(spell(3));
+        return static_cast<long>(out.size());
+    });
+    row("BinTree", "emplace deepest", [&] {
+        bool inserted = copy.emplace(spell(2));
+        ok = ok && inserted;
+        return inserted;
+    });
+    ok = ok && copy == bt;
+    row("BinTree", "insert deepest", [&] {
+        bool inserted = copy.insert(new NodeData(spell(1)));
+        ok = ok && inserted;
+        return inserted;
+    });
+    row("BinTree", "retrieve deepest", [&] {
+        NodeData* ret;
+        bool found = copy.retrieve(NodeData(spell(1)), ret);
+        ok = ok && found;
+        return found;
+    });
+    row("BinTree", "getDepth", [&] {
+        int depth = copy.getDepth(NodeData(spell(1)));
+        ok = ok && depth == height + 1;
+        return depth;
+    });
+
+    char path[] = "/tmp/bintree-deep-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        cout << "can't create a temporary file; skipping deep save" << endl;
+    } else {
+        close(fd);
+        BinTree loaded;
+        row("BinTree/splay", "save", [&] {
+            return bt.save(path);
+        });
+        row("BinTree", "load", [&] {
+            bool reloaded = loaded.load(path);
+            ok = ok && reloaded;
+            return loaded.size();
+        });
+        ok = ok && loaded == bt;
+        unlink(path);
+
+        // hang the path off the right of a smaller root, so erasing that
+        // root takes its successor from the bottom of the path.
+        BinTree low;
+        low.insert(new NodeData(spell(1)));
+        low.join(loaded);
+        low.insert(new NodeData(spell(0)));
+        row("BinTree", "erase (successor deepest)", [&] {
+            bool erased = low.erase(NodeData(spell(1)));
+            ok = ok && erased && low.size() == n + 1;
+            return erased;
+        });
+        vector<NodeData*> arr(n + 1);
+        row("BinTree", "bstreeToArray", [&] {
+            low.bstreeToArray(arr.data());
+            return static_cast<long>(arr.size());
+        });
+        ok = ok && *arr[0] == NodeData(spell(0)) &&
+             *arr[n] == NodeData(spell(n + 1));
+        for (NodeData* nd : arr) {
+            delete nd;
+        }
+    }
+    vector<NodeData*> sorted;
+    row("BinTree", "bstreeToArray (vector)", [&] {
+        copy.bstreeToArray(sorted);
+        return static_cast<long>(sorted.size());
+    });
+    ok = ok && sorted.size() == static_cast<size_t>(n + 1) &&
+         is_sorted(sorted.begin(), sorted.end(),
+                   [](const NodeData* a, const NodeData* b) {
+                       return *a < *b;
+                   });
+    for (NodeData* nd : sorted) {
+        delete nd;
+    }
+
+    if (!ok) {
+        cout << "FAILED: an operation on a deep tree went wrong" << endl;
+    }
+    return ok;
+}
+
+/** ===========================================================================
+    Builds one tree per "$$"-terminated run of tokens in a file, plus one
+    for any tokens after the last "$$", reading with ifstream >> as
+    driver.cpp's buildTree does. Returns the number of NodeData inserted,
+    -1 if the file can't be opened.
+---------------------------------------------------------------------------- */
+long streamTrees(const string& path, deque<BinTree>& trees) {
+    ifstream in(path);
+    if (!in) return -1;
+
+    long inserted = 0;
+    BinTree* cur = nullptr;
+    string s;
+    while (in >> s) {
+        if (cur == nullptr) {
+            cur = &trees.emplace_back();
+        }
+        if (s == "$$") {
+            cur = nullptr;
+            continue;
+        }
+        NodeData* nd = new NodeData(s);
+        if (cur->insert(nd)) {
+            inserted++;
+        } else {
+            delete nd;
+        }
+    }
+    return inserted;
+}
+
+/** ===========================================================================
+    streamTrees through ingestTree over a memory-mapped copy of the file.
+---------------------------------------------------------------------------- */
+long mappedTrees(const string& path, deque<BinTree>& trees) {
+    MappedFile file;
+    if (!file.open(path)) return -1;
+
+    long inserted = 0;
+    Tokenizer in(file.data(), file.size());
+    while (!in.atEnd()) {
+        inserted += ingestTree(trees.emplace_back(), in);
+    }
+    return inserted;
+}
+
+/** ===========================================================================
+    Returns true if both lists hold the same number of trees and each pair
+    is equal in contents and shape.
+---------------------------------------------------------------------------- */
+bool sameTrees(const deque<BinTree>& a, const deque<BinTree>& b) {
+    if (a.size() != b.size()) return false;
+
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+/** ===========================================================================
+    Returns true if a copy of the tree, and the tree saved to a temporary
+    file and loaded back, both compare equal to it and diff finds nothing.
+    Splaying rewrites Nodes' children, so this catches any it leaves with
+    stale cached hashes.
+---------------------------------------------------------------------------- */
+bool sameSaved(const BinTree& bt) {
+    char path[] = "/tmp/bintree-save-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        cout << "can't create a temporary file; skipping save check" << endl;
+        return true;
+    }
+    close(fd);
+    BinTree copy(bt);
+    BinTree loaded;
+    bool reloaded = bt.save(path) && loaded.load(path);
+    unlink(path);
+
+    vector<NodeData*> fromCopy, fromLoaded;
+    bt.diff(copy, fromCopy);
+    bt.diff(loaded, fromLoaded);
+    return reloaded && bt == copy && bt == loaded && fromCopy.empty() &&
+           fromLoaded.empty();
+}
+
+/** ===========================================================================
+    Generates n keys of the given kind. Random and skewed keys are scattered
+    over a 40-bit range by an odd multiplier (a bijection), so neither their
+    order nor their popularity follows their numeric value.
+---------------------------------------------------------------------------- */
+vector<int64_t> makeStream(Workload w, int n, mt19937_64& rng) {
+    const uint64_t MASK = (uint64_t(1) << 40) - 1;
+    auto scatter = [MASK](uint64_t v) {
+        return static_cast<int64_t>((v * 0x9e3779b97f4a7c15ULL) & MASK);
+    };
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    int distinct = max(1, n / 100); // dup-heavy: each key about 100 times
+    int hot = max(1, n / 100);      // hot-set: 1% of keys draw 90%
+
+    vector<int64_t> keys(n);
+    for (int i = 0; i < n; i++) {
+        switch (w) {
+        case SORTED:     keys[i] = i; break;
+        case REVERSE:    keys[i] = n - 1 - i; break;
+        case RANDOM:     keys[i] = scatter(i); break;
+        // n^u - 1 for uniform u has density ~1/x: approximately Zipf(1).
+        case ZIPF:       keys[i] = scatter(static_cast<uint64_t>(
+                             pow(n + 1.0, unit(rng)) - 1)); break;
+        case HOTSET:     keys[i] = scatter(rng() % 10 != 0 ? rng() % hot
+                                                           : rng() % n); break;
+        case DUPLICATES: keys[i] = scatter(rng() % distinct); break;
+        }
+    }
+    if (w == RANDOM) {
+        shuffle(keys.begin(), keys.end(), rng);
+    }
+    return keys;
+}
+
+/** ===========================================================================
+    Spells a key as fixed-width decimal, so string order is numeric order.
+---------------------------------------------------------------------------- */
+string spell(int64_t v) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%013lld", static_cast<long long>(v));
+    return buf;
+}
+
+/** ===========================================================================
+    Runs body once and prints its time and heap allocations divided by ops,
+    along with the count it returns.
+---------------------------------------------------------------------------- */
+void timed(const string& engine, const string& op, int ops,
+           const function<long()>& body) {
+    long before = allocations.load(memory_order_relaxed);
+    auto start = chrono::steady_clock::now();
+    long found = body();
+    double ns = nsPerOp(start, ops);
+    long allocs = allocations.load(memory_order_relaxed) - before;
+    cout << engine << "\t" << op << "\t" << ns << "\t"
+         << (ops > 0 ? static_cast<double>(allocs) / ops : 0.0) << "\t"
+         << found << endl;
+}
+
+/** ===========================================================================
+    Returns the process' peak resident set size so far, in kilobytes.
+---------------------------------------------------------------------------- */
+long peakRssKB() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // kilobytes on Linux
+}
+
+/** ===========================================================================
+    Returns the average time per operation since start, in nanoseconds.
+---------------------------------------------------------------------------- */
+double nsPerOp(chrono::steady_clock::time_point start, int ops) {
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    return (ops > 0) ? elapsed.count() / ops : 0.0;
+}
+
+/** ===========================================================================
+    Prints one result line. found is printed so the work can't be optimized
+    away and so the engines can be checked against each other.
+---------------------------------------------------------------------------- */
+void report(const string& engine, const string& op, double ns, long found) {
+    cout << engine << "\t" << op << "\t" << ns << " ns/op\t" << found << endl;
+}
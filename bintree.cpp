@@ -1,4 +1,97 @@
 #include "bintree.h"
+#include "mappedfile.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+// ranges smaller than this are sorted or built on the calling thread.
+static const int PARALLEL_GRAIN = 1 << 14;
+
+// targets a batched search walks down the tree side by side.
+static const int BATCH_GROUP = 16;
+
+// asks for the cache line at p ahead of use. only a hint, so compilers
+// without the builtin just skip it.
+static inline void prefetch(const void* p) {
+#if defined(__GNUC__)
+    __builtin_prefetch(p);
+#else
+    (void)p;
+#endif
+}
+
+#ifdef BINTREE_STATS
+// Nodes visited and NodeData compared by this thread's current operation,
+// added to the tree's counters when the operation ends.
+static thread_local uint64_t opVisits = 0;
+static thread_local uint64_t opCompares = 0;
+
+#define STAT_BEGIN() (opVisits = opCompares = 0)
+#define STAT_VISIT(prefix, n) \
+    (opVisits++, opCompares += ((prefix) == (n)->prefix))
+#define STAT_ADD(field, k) counters.field.fetch_add((k), memory_order_relaxed)
+#define STAT_END(op) (STAT_ADD(op##s, 1), STAT_ADD(op##Visits, opVisits), \
+                      STAT_ADD(op##Compares, opCompares))
+#else
+#define STAT_BEGIN() ((void)0)
+#define STAT_VISIT(prefix, n) ((void)0)
+#define STAT_ADD(field, k) ((void)0)
+#define STAT_END(op) ((void)0)
+#endif
+
+/** ===========================================================================
+    Sorts by NodeData value, stably, using up to the given number of threads:
+    each thread sorts one slice, then neighbouring slices are merged pairwise
+    in parallel rounds.
+---------------------------------------------------------------------------- */
+static void parallelSort(vector<NodeData*>& v, int threads) {
+    auto less = [](const NodeData* a, const NodeData* b) { return *a < *b; };
+    int n = static_cast<int>(v.size());
+    int slices = min(threads, max(1, n / PARALLEL_GRAIN));
+    if (slices == 1) {
+        stable_sort(v.begin(), v.end(), less); // no thread worth starting
+        return;
+    }
+    vector<int> bound(slices + 1);
+    for (int s = 0; s <= slices; s++) {
+        bound[s] = static_cast<int>(static_cast<long>(n) * s / slices);
+    }
+
+    // each round hands all but its last task to new threads and runs that
+    // one on the calling thread.
+    vector<thread> workers;
+    for (int s = 0; s < slices; s++) {
+        auto sortSlice = [&v, &bound, less, s] {
+            stable_sort(v.begin() + bound[s], v.begin() + bound[s + 1], less);
+        };
+        if (s + 1 < slices) {
+            workers.emplace_back(sortSlice);
+        } else {
+            sortSlice();
+        }
+    }
+    for (thread& w : workers) w.join();
+
+    for (int width = 1; width < slices; width *= 2) {
+        workers.clear();
+        for (int s = 0; s + width < slices; s += 2 * width) {
+            int lo = bound[s];
+            int mid = bound[s + width];
+            int hi = bound[min(s + 2 * width, slices)];
+            auto mergePair = [&v, less, lo, mid, hi] {
+                inplace_merge(v.begin() + lo, v.begin() + mid,
+                              v.begin() + hi, less);
+            };
+            if (s + 3 * width < slices) {
+                workers.emplace_back(mergePair);
+            } else {
+                mergePair(); // the round's last pair
+            }
+        }
+        for (thread& w : workers) w.join();
+    }
+}
 
 /** ===========================================================================
     Constructors/ Destructors
@@ -12,58 +105,112 @@ BinTree::BinTree(const BinTree & rhs) {
 
 BinTree::~BinTree() {
     makeEmpty();
+    reclaim(true);
 }
 
 /** ===========================================================================
     Operator Overrides
 ---------------------------------------------------------------------------- */
 ostream& operator<<(ostream& out, const BinTree& bt) {
+    BufferedWriter w(out);
     if (bt.isEmpty()) {
-        cout << "! -- tree is empty -- !" << endl;
+        w.write("! -- tree is empty -- !\n");
     } else {
-        bt.inorder(out);
-        out << endl;
+        bt.inorder(w);
+        w.put('\n');
     }
+    w.flush();
     return out;
 }
 
 void BinTree::inorder(ostream & out) const {
+    BufferedWriter w(out);
+    inorderHelper(root, w);
+}
+
+void BinTree::inorder(BufferedWriter& out) const {
     inorderHelper(root, out);
 }
 
-void BinTree::inorderHelper(Node* n, ostream & out) const {
-    if (n == nullptr) {
-        return;
+void BinTree::inorderHelper(const Node* n, BufferedWriter& out) const {
+    // walk with a stack: a splayed tree may be too deep to recurse.
+    vector<const Node*> stack; // Nodes whose left subtree is being printed
+    stack.reserve(height(n));
+    while (n != nullptr || !stack.empty()) {
+        while (n != nullptr) {
+            stack.push_back(n);
+            n = n->left;
+        }
+        n = stack.back();
+        stack.pop_back();
+        out.write(n->data->getData());
+        out.put(' ');
+        n = n->right;
     }
-    inorderHelper(n->left, out);
-    out << *n->data << " ";
-    inorderHelper(n->right, out);
 }
 
 BinTree& BinTree::operator=(const BinTree& rhs) {
     if (this != &rhs) {
-        copySubtree(root, rhs.root);
+        balance = rhs.balance;
+        if (rhs.persistent && !concurrent) {
+            // share rhs's Nodes. count the new reference before dropping
+            // ours, in case they are the same Nodes.
+            Node* shared = rhs.root;
+            if (shared != nullptr) shared->refs++;
+            setIndexed(false); // shared NodeData can't be indexed
+            makeEmpty();
+            pool = rhs.pool;
+            root = shared;
+            persistent = true;
+        } else if (concurrent) {
+            // readers may be on our Nodes, so copy into new ones instead.
+            Node* fresh = nullptr;
+            copySubtree(fresh, rhs.root);
+            replaceRoot(fresh);
+        } else {
+            if (persistent) {
+                pluck(root); // our Nodes may be shared, so don't overwrite
+            }
+            copySubtree(root, rhs.root);
+            if (indexed) {
+                reindex(); // copySubtree overwrote our NodeData's keys
+            }
+        }
     }
     return *this;
 }
 
 void BinTree::copySubtree(Node*& lhs, Node* rhs) {
-    if (rhs == nullptr) {
-        // nothing to copy, delete extra nodes, if any.
-        pluck(lhs);
-        return;
-    }
+    // walk with a stack: a splayed tree may be too deep to recurse.
+    vector<pair<Node**, const Node*>> stack; // our slot, the Node to copy
+    stack.push_back({&lhs, rhs});
+    while (!stack.empty()) {
+        auto [slot, from] = stack.back();
+        stack.pop_back();
+        if (from == nullptr) {
+            // nothing to copy, delete extra nodes, if any.
+            pluck(*slot);
+            continue;
+        }
 
-    if (lhs == nullptr) {
-        // needs child node. allocate memory.
-        lhs = new Node();
-        lhs->data = new NodeData(*rhs->data);
-    } else {
-        // existing child node. overwrite.
-        *lhs->data = *rhs->data;
+        Node* to = *slot;
+        if (to == nullptr) {
+            // needs child node. allocate memory.
+            to = *slot = newNode();
+            to->data = new NodeData(*from->data);
+        } else {
+            // existing child node. overwrite.
+            *to->data = *from->data;
+        }
+        to->prefix = from->prefix;
+        to->height = from->height;
+        // from's cache may be being filled by a comparison on another thread.
+        to->hashed = atomic_ref<bool>(from->hashed).load(memory_order_acquire);
+        to->hash = atomic_ref<size_t>(from->hash).load(memory_order_relaxed);
+        to->size = from->size;
+        stack.push_back({&to->right, from->right});
+        stack.push_back({&to->left, from->left});
     }
-    copySubtree(lhs->left, rhs->left);
-    copySubtree(lhs->right, rhs->right);
 }
 
 bool BinTree::operator==(const BinTree& rhs) const {
@@ -71,115 +218,1132 @@ bool BinTree::operator==(const BinTree& rhs) const {
 }
 
 bool BinTree::checkEqual(const Node* n, const Node* rhs) const {
-    // reached end of leaves without tests failing.
-    // if either are null, but not both, they are not identical.
-    if (n == nullptr && rhs == nullptr) return true;
-    else if (n == nullptr ^ rhs == nullptr) return false;
+    // compare with a stack: a splayed tree may be too deep to recurse.
+    vector<pair<const Node*, const Node*>> stack; // pairs still to compare
+    stack.reserve(height(n) + 1);
+    stack.push_back({n, rhs});
+    while (!stack.empty()) {
+        n = stack.back().first;
+        rhs = stack.back().second;
+        stack.pop_back();
+
+        // reached end of leaves without tests failing.
+        // if either are null, but not both, they are not identical.
+        if (n == rhs) continue; // both null, or a subtree the trees share
+        else if (n == nullptr ^ rhs == nullptr) return false;
+
+        // different hashes are proof of difference; equal ones are not.
+        if (subtreeHash(n) != subtreeHash(rhs)) return false;
 
-    return checkEqual(n->left, rhs->left) &&
-           checkEqual(n->right, rhs->right) && 
-           *n->data == *rhs->data;
+        if (*n->data != *rhs->data) return false;
+        stack.push_back({n->right, rhs->right});
+        stack.push_back({n->left, rhs->left});
+    }
+    return true;
 }
 
 bool BinTree::operator!=(const BinTree& rhs) const {
     return !(*this == rhs);
 }
 
+size_t BinTree::subtreeHash(const Node* n) const {
+    // const callers on several threads may fill the cache at once. they
+    // store the same value, and hashed is only set once hash is.
+    auto cached = [](const Node* c) {
+        return c == nullptr ||
+               atomic_ref<bool>(c->hashed).load(memory_order_acquire);
+    };
+    auto hashOf = [](const Node* c) -> size_t {
+        return (c == nullptr)
+             ? 0 : atomic_ref<size_t>(c->hash).load(memory_order_relaxed);
+    };
+
+    // fill stale hashes in bottom up, with a stack: a splayed tree may be
+    // too deep to recurse. a Node stays on it until both children are done.
+    vector<const Node*> stack;
+    if (!cached(n)) {
+        stack.reserve(height(n));
+        stack.push_back(n);
+    }
+    while (!stack.empty()) {
+        const Node* c = stack.back();
+        if (!cached(c->left)) {
+            stack.push_back(c->left);
+            continue;
+        }
+        if (!cached(c->right)) {
+            stack.push_back(c->right);
+            continue;
+        }
+        stack.pop_back();
+
+        // mix in order: data, then left, then right, so shape matters.
+        size_t h = c->data->hash();
+        for (size_t child : {hashOf(c->left), hashOf(c->right)}) {
+            h ^= child + 0x9e3779b97f4a7c15ULL + (h << 12) + (h >> 4);
+        }
+        atomic_ref<size_t>(c->hash).store(h, memory_order_relaxed);
+        atomic_ref<bool>(c->hashed).store(true, memory_order_release);
+    }
+    return hashOf(n);
+}
+
+void BinTree::diff(const BinTree& rhs, vector<NodeData*>& out) const {
+    diff(root, rhs.root, out);
+}
+
+void BinTree::diff(const Node* n, const Node* rhs,
+                   vector<NodeData*>& out) const {
+    // walk with a stack, left before right so out stays in tree order: a
+    // splayed tree may be too deep to recurse.
+    vector<pair<const Node*, const Node*>> stack; // pairs still to compare
+    stack.reserve(height(n) + 1);
+    stack.push_back({n, rhs});
+    while (!stack.empty()) {
+        n = stack.back().first;
+        rhs = stack.back().second;
+        stack.pop_back();
+        if (n == nullptr) continue;
+        if (n == rhs ||
+            (rhs != nullptr && subtreeHash(n) == subtreeHash(rhs))) {
+            continue;
+        }
+
+        bool shapeDiffers = rhs == nullptr ||
+            (n->left == nullptr) != (rhs->left == nullptr) ||
+            (n->right == nullptr) != (rhs->right == nullptr);
+        if (shapeDiffers || *n->data != *rhs->data) {
+            out.push_back(n->data);
+            continue;
+        }
+        stack.push_back({n->right, rhs->right});
+        stack.push_back({n->left, rhs->left});
+    }
+}
+
 /** ===========================================================================
     BinTree Functions
 ---------------------------------------------------------------------------- */
 bool BinTree::isEmpty() const {
-    return (root == nullptr);
+    return (load(root) == nullptr);
 }
 
 void BinTree::makeEmpty(const bool& keep) {
-    pluck(root, keep);
-}
+    index.clear();
+    if (concurrent) {
+        // unlink everything now, free it once readers have moved on.
+        Node* old = root;
+        publish(root, nullptr);
+        retire(old, true, keep);
+        reclaim();
+        return;
+    }
 
-void BinTree::pluck(Node*& n, const bool& keepND) {
-    if (n == nullptr) return;
+    if (pool.use_count() > 1) {
+        // other trees use the pool, and perhaps some of our Nodes.
+        if (keep) {
+            unshare(root); // the caller must get NodeData nobody else has
+        }
+        pluck(root, keep);
+        return;
+    }
 
-    pluck(n->left, keepND);
-    pluck(n->right, keepND);
+    // every Node belongs to this tree, so the pool can go all at once.
+    if (!keep) {
+        deleteData(root);
+    }
+    STAT_ADD(frees, sizeOf(root));
+    root = nullptr;
+    pool->clear();
+}
 
-    // delete node data.
-    if (!keepND) {
+void BinTree::deleteData(Node* n) {
+    // walk with a stack: a splayed tree may be too deep to recurse. only
+    // Nodes with two children push one, so a path needs no stack at all.
+    vector<Node*> pending; // right subtrees still to visit
+    while (n != nullptr) {
         delete n->data;
         n->data = nullptr;
+        Node* next = n->left;
+        if (n->right != nullptr) {
+            if (next == nullptr) {
+                next = n->right;
+            } else {
+                pending.push_back(n->right);
+            }
+        }
+        if (next == nullptr && !pending.empty()) {
+            next = pending.back();
+            pending.pop_back();
+        }
+        n = next;
     }
+}
+
+BinTree::Node* BinTree::newNode() {
+    STAT_ADD(allocations, 1);
+    return pool->allocate();
+}
+
+void BinTree::freeNode(Node* n) {
+    STAT_ADD(frees, 1);
+    pool->release(n);
+}
+
+BinTree::Node* BinTree::load(Node* const& p) {
+    return atomic_ref<Node*>(const_cast<Node*&>(p)).load(memory_order_acquire);
+}
+
+void BinTree::publish(Node*& p, Node* v) {
+    atomic_ref<Node*>(p).store(v, memory_order_release);
+}
+
+BinTree::Node* BinTree::clone(const Node* n) {
+    Node* c = newNode();
+    *c = *n;
+    return c;
+}
+
+BinTree::Node* BinTree::cloneSubtree(const Node* n) {
+    Node* top = nullptr;
+    vector<pair<const Node*, Node**>> stack; // original, where its copy goes
+    if (n != nullptr) stack.push_back({n, &top});
+    while (!stack.empty()) {
+        auto [from, to] = stack.back();
+        stack.pop_back();
+        Node* c = clone(from);
+        *to = c;
+        if (from->left != nullptr) stack.push_back({from->left, &c->left});
+        if (from->right != nullptr) stack.push_back({from->right, &c->right});
+    }
+    return top;
+}
+
+void BinTree::setConcurrent(bool on) {
+    if (on) {
+        setPersistent(false);
+        setIndexed(false);
+    }
+    concurrent = on;
+    if (!on) {
+        reclaim(true);
+    }
+}
+
+bool BinTree::isConcurrent() const {
+    return concurrent;
+}
+
+void BinTree::setPersistent(bool on) {
+    if (on) {
+        setConcurrent(false);
+        setIndexed(false);
+    } else {
+        unshare(root);
+    }
+    persistent = on;
+}
+
+bool BinTree::isPersistent() const {
+    return persistent;
+}
+
+void BinTree::setIndexed(bool on) {
+    if (on) {
+        // own() copies NodeData and concurrent readers can't share the
+        // index, so neither mode can keep it.
+        setConcurrent(false);
+        setPersistent(false);
+    }
+    indexed = on;
+    if (on) {
+        reindex();
+    } else {
+        index.clear();
+    }
+}
 
-    // delete node itself.
-    delete n;
+bool BinTree::isIndexed() const {
+    return indexed;
+}
+
+void BinTree::reindex() {
+    index.clear();
+    index.reserve(size());
+    // walk with a stack: an unbalanced tree may be too deep to recurse.
+    vector<const Node*> stack;
+    if (root != nullptr) stack.push_back(root);
+    while (!stack.empty()) {
+        const Node* n = stack.back();
+        stack.pop_back();
+        index.insert(n->data);
+        if (n->left != nullptr) stack.push_back(n->left);
+        if (n->right != nullptr) stack.push_back(n->right);
+    }
+}
+
+void BinTree::own(Node*& n) {
+    if (n == nullptr || n->refs == 1) return;
+
+    // the copy is a new parent for both children.
+    Node* copy = newNode();
+    *copy = *n;
+    copy->refs = 1;
+    copy->data = new NodeData(*n->data);
+    if (copy->left != nullptr) copy->left->refs++;
+    if (copy->right != nullptr) copy->right->refs++;
+    n->refs--;
+    n = copy;
+}
+
+void BinTree::unshare(Node*& n) {
+    // walk with a stack: a splayed tree may be too deep to recurse.
+    vector<Node**> stack{&n};
+    while (!stack.empty()) {
+        Node*& c = *stack.back();
+        stack.pop_back();
+        if (c == nullptr) continue;
+
+        own(c);
+        stack.push_back(&c->right);
+        stack.push_back(&c->left);
+    }
+}
+
+void BinTree::retire(Node* n, bool subtree, bool keepND) {
+    if (n == nullptr) return;
+    limbo.push_back(Retired{n, EpochDomain::global().retire(), subtree,
+                            keepND});
+}
+
+void BinTree::reclaim(bool force) {
+    if (limbo.empty()) return;
+
+    // tags only grow, so everything safe is at the front.
+    uint64_t horizon = force ? UINT64_MAX : EpochDomain::global().horizon();
+    size_t done = 0;
+    for (; done < limbo.size() && limbo[done].tag < horizon; done++) {
+        Retired& r = limbo[done];
+        if (r.subtree) {
+            pluck(r.n, r.keepND);
+        } else {
+            if (!r.keepND) delete r.n->data;
+            freeNode(r.n);
+        }
+    }
+    limbo.erase(limbo.begin(), limbo.begin() + done);
+}
+
+void BinTree::replaceRoot(Node* fresh) {
+    Node* old = root;
+    publish(root, fresh);
+    retire(old, true, false);
+    reclaim();
+}
+
+void BinTree::pluck(Node*& n, const bool& keepND) {
+    // walk with a stack, as deleteData does.
+    vector<Node*> pending; // right subtrees still to free
+    Node* c = n;
     n = nullptr;
+    while (c != nullptr) {
+        Node* next = nullptr;
+        if (c->refs > 1) {
+            // another tree still uses this subtree. just let go of it.
+            c->refs--;
+        } else {
+            next = c->left;
+            if (c->right != nullptr) {
+                if (next == nullptr) {
+                    next = c->right;
+                } else {
+                    pending.push_back(c->right);
+                }
+            }
+
+            // delete node data.
+            if (!keepND) {
+                delete c->data;
+                c->data = nullptr;
+            }
+
+            // recycle node itself.
+            freeNode(c);
+        }
+        if (next == nullptr && !pending.empty()) {
+            next = pending.back();
+            pending.pop_back();
+        }
+        c = next;
+    }
 }
 
 bool BinTree::insert(NodeData* nd) {
     if (nd == nullptr) return false;
 
-    return insert(nd, root);
+    STAT_BEGIN();
+    bool inserted = false;
+    if (!concurrent) {
+        // in persistent mode, don't copy a path just to find a duplicate.
+        NodeData* found;
+        if (indexed) {
+            // the index spots duplicates without a descent.
+            if (index.find(nd->getData()) == nullptr) {
+                inserted = insert(nd, nd->prefix(), root);
+                index.insert(nd);
+            }
+        } else if (!persistent || !retrieve(root, *nd, nd->prefix(), found)) {
+            inserted = insert(nd, nd->prefix(), root);
+        }
+        if (balance == SPLAY && (inserted || !persistent)) {
+            splay(root, *nd, nd->prefix(), found);
+        }
+    } else if (balance == UNBALANCED) {
+        inserted = insertShared(nd);
+    } else {
+        lock_guard<mutex> lock(writeMutex);
+        inserted = insert(nd, nd->prefix(), root);
+        if (balance == SPLAY) {
+            NodeData* found;
+            splay(root, *nd, nd->prefix(), found);
+        }
+        reclaim();
+    }
+    STAT_END(insert);
+    STAT_ADD(duplicates, !inserted);
+    return inserted;
+}
+
+bool BinTree::insertShared(NodeData* nd) {
+    vector<Node*> path;     // Nodes passed on the way down
+    Node* fresh = nullptr;  // allocated once, reused if a CAS is lost
+    uint64_t prefix = nd->prefix();
+    Node** link = &root;
+    while (true) {
+        Node* n = load(*link);
+        if (n == nullptr) {
+            if (fresh == nullptr) {
+                lock_guard<mutex> lock(writeMutex); // pool is not shared
+                fresh = newNode();
+                attach(fresh, nd);
+            }
+            Node* expected = nullptr;
+            if (atomic_ref<Node*>(*link).compare_exchange_strong(
+                    expected, fresh, memory_order_release,
+                    memory_order_acquire)) {
+                break;
+            }
+            continue; // another thread linked a Node here first. go on down.
+        }
+        int c = compareTo(*nd, prefix, n);
+        if (c == 0) {
+            if (fresh != nullptr) {
+                lock_guard<mutex> lock(writeMutex);
+                freeNode(fresh);
+            }
+            return false;
+        }
+        path.push_back(n);
+        link = (c < 0) ? &n->left : &n->right;
+    }
+
+    // every Node above the new leaf has grown by one. the k-th is at least
+    // k + 1 high, and no longer has the hash it had.
+    int h = 2;
+    for (auto it = path.rbegin(); it != path.rend(); ++it, ++h) {
+        atomic_ref<int>((*it)->size).fetch_add(1, memory_order_relaxed);
+        atomic_ref<bool>((*it)->hashed).store(false, memory_order_relaxed);
+        atomic_ref<int> height((*it)->height);
+        int cur = height.load(memory_order_relaxed);
+        while (cur < h &&
+               !height.compare_exchange_weak(cur, h, memory_order_relaxed)) {
+        }
+    }
+    return true;
 }
 
-bool BinTree::insert(NodeData* nd, Node*& n) {
+bool BinTree::insert(NodeData* nd, uint64_t prefix, Node*& n) {
+    // links to each Node on the way down, kept between calls like splay's.
+    thread_local vector<Node**> path;
+    path.clear();
+    Node** link = &n;
     // ignore duplicates, insert if nullptr found.
-    if (n == nullptr) {
-        n = new Node();
-        n->data = nd;
-        return true;
-    } else if (*nd == *n->data) {
+    while (*link != nullptr) {
+        int c = compareTo(*nd, prefix, *link);
+        if (c == 0) {
+            return false;
+        }
+
+        // search left if smaller, right if bigger. *link is about to change.
+        own(*link);
+        path.push_back(link);
+        link = (c < 0) ? &(*link)->left : &(*link)->right;
+    }
+
+    // fill the Node in before readers can see it.
+    Node* fresh = newNode();
+    attach(fresh, nd);
+    publish(*link, fresh);
+    retrace(path);
+    return true;
+}
+
+bool BinTree::insert(string_view key, uint64_t prefix, Node*& n) {
+    thread_local vector<Node**> path;
+    path.clear();
+    Node** link = &n;
+    while (*link != nullptr) {
+        int c = compareTo(key, prefix, *link);
+        if (c == 0) {
+            return false;
+        }
+        path.push_back(link);
+        link = (c < 0) ? &(*link)->left : &(*link)->right;
+    }
+    *link = newNode();
+    attach(*link, new NodeData(string(key)));
+    retrace(path);
+    return true;
+}
+
+void BinTree::retrace(const vector<Node**>& path) {
+    // fix up sizes and heights (and shape, if balancing) from the bottom.
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        update(**it);
+        if (balance == AVL) {
+            rebalance(**it);
+        }
+    }
+}
+
+void BinTree::setBalance(Balance b) {
+    balance = b;
+}
+
+BinTree::Balance BinTree::getBalance() const {
+    return balance;
+}
+
+int BinTree::height(const Node* n) {
+    return (n == nullptr) ? 0 : n->height;
+}
+
+int BinTree::sizeOf(const Node* n) {
+    return (n == nullptr) ? 0 : n->size;
+}
+
+void BinTree::attach(Node* n, NodeData* nd) {
+    n->data = nd;
+    n->prefix = nd->prefix();
+}
+
+int BinTree::compareTo(const NodeData& key, uint64_t prefix, const Node* n) {
+    STAT_VISIT(prefix, n);
+    if (prefix != n->prefix) {
+        return (prefix < n->prefix) ? -1 : 1;
+    }
+    return key.compare(*n->data);
+}
+
+int BinTree::compareTo(string_view key, uint64_t prefix, const Node* n) {
+    STAT_VISIT(prefix, n);
+    if (prefix != n->prefix) {
+        return (prefix < n->prefix) ? -1 : 1;
+    }
+    int c = n->data->compare(key);
+    return (c < 0) - (c > 0); // key against n, not n against key
+}
+
+void BinTree::update(Node* n) {
+    int hl = height(n->left);
+    int hr = height(n->right);
+    n->height = 1 + (hl > hr ? hl : hr);
+    n->size = 1 + sizeOf(n->left) + sizeOf(n->right);
+    n->hashed = false;
+}
+
+void BinTree::rotateLeft(Node*& n) {
+    own(n);
+    own(n->right);
+    Node* old = n;
+    Node* r = n->right;
+    bool live = concurrent && !offline;
+    if (live) {
+        // readers may be on n or r: rotate copies, then swap them in.
+        old = clone(n);
+        r = clone(r);
+    }
+    old->right = r->left;
+    r->left = old;
+    update(old);
+    update(r);
+    if (live) {
+        // the originals are unreachable once the copies are published.
+        Node* orig = n;
+        publish(n, r);
+        retire(orig->right, false, true); // data lives on in the copies
+        retire(orig, false, true);
+        return;
+    }
+    n = r;
+}
+
+void BinTree::rotateRight(Node*& n) {
+    own(n);
+    own(n->left);
+    Node* old = n;
+    Node* l = n->left;
+    bool live = concurrent && !offline;
+    if (live) {
+        // readers may be on n or l: rotate copies, then swap them in.
+        old = clone(n);
+        l = clone(l);
+    }
+    old->left = l->right;
+    l->right = old;
+    update(old);
+    update(l);
+    if (live) {
+        // the originals are unreachable once the copies are published.
+        Node* orig = n;
+        publish(n, l);
+        retire(orig->left, false, true); // data lives on in the copies
+        retire(orig, false, true);
+        return;
+    }
+    n = l;
+}
+
+void BinTree::rebalance(Node*& n) {
+    int skew = height(n->left) - height(n->right);
+    if (skew > 1) {
+        // left heavy. left-right case needs its child straightened first.
+        if (height(n->left->left) < height(n->left->right)) {
+            rotateLeft(n->left);
+        }
+        rotateRight(n);
+    } else if (skew < -1) {
+        // right heavy. right-left case is the mirror image.
+        if (height(n->right->right) < height(n->right->left)) {
+            rotateRight(n->right);
+        }
+        rotateLeft(n);
+    }
+}
+
+void BinTree::splay(Node*& n, const NodeData& target, uint64_t prefix,
+                    NodeData*& ret) {
+    // links to each Node on the way down. kept between calls, since a
+    // splay tree's paths can be too long to walk by recursion.
+    thread_local vector<Node**> path;
+    path.clear();
+    Node** link = &n;
+    while (true) {
+        int c = compareTo(target, prefix, *link);
+        Node* next = (c < 0) ? (*link)->left : (*link)->right;
+        if (c == 0 || next == nullptr) {
+            // found, or as close as the tree gets.
+            ret = (c == 0) ? (*link)->data : nullptr;
+            break;
+        }
+        own(*link); // its child pointer may be rewritten below
+        path.push_back(link);
+        link = (c < 0) ? &(*link)->left : &(*link)->right;
+    }
+
+    // lift the Node two levels at a time, leaving an odd top level be.
+    for (size_t i = path.size(); i >= 2; i -= 2) {
+        Node*& g = *path[i - 2];
+        Node*& p = *path[i - 1];
+        bool pLeft = (g->left == p);
+        bool xLeft = (p->left == *link);
+        if (pLeft != xLeft) {
+            // zig-zag: straighten it first.
+            if (xLeft) {
+                rotateRight(p);
+            } else {
+                rotateLeft(p);
+            }
+        }
+        if (pLeft) {
+            rotateRight(g);
+        } else {
+            rotateLeft(g);
+        }
+        link = &g;
+    }
+    if (path.size() % 2 == 1) {
+        update(*path[0]); // its child was rotated, but it was not
+    }
+}
+
+bool BinTree::emplace(string_view key) {
+    if (!concurrent && !persistent && !indexed && balance != SPLAY) {
+        STAT_BEGIN();
+        bool inserted = insert(key, NodeData::prefixOf(key), root);
+        STAT_END(insert);
+        STAT_ADD(duplicates, !inserted);
+        return inserted;
+    }
+
+    // look first, so a duplicate costs no allocation.
+    NodeData* found;
+    if (retrieve(key, found)) {
+        STAT_ADD(inserts, 1);
+        STAT_ADD(duplicates, 1);
+        return false;
+    }
+    NodeData* nd = new NodeData(string(key));
+    if (!insert(nd)) {
+        delete nd; // another writer inserted it in the meantime
         return false;
     }
+    return true;
+}
 
-    // search left if smaller, right if bigger.
-    Node*& next = (*nd < *n->data) ? n->left : n->right;
-    return insert(nd, next);
+bool BinTree::retrieve(string_view key, NodeData*& ret) const {
+    STAT_BEGIN();
+    bool found;
+    if (indexed) {
+        ret = index.find(key);
+        found = (ret != nullptr);
+    } else if (concurrent) {
+        EpochGuard pin;
+        found = find(key, ret);
+    } else {
+        found = find(key, ret);
+    }
+    STAT_END(retrieve);
+    return found;
 }
 
-bool BinTree::retrieve(const NodeData& target, NodeData*& ret) const {
-    if (isEmpty()) return false;
-    retrieve(root, target, ret);
-    return (ret != nullptr);
+int BinTree::retrieveBatch(const NodeData* const targets[], int count,
+                           NodeData* ret[]) const {
+    STAT_BEGIN();
+    if (indexed) {
+        for (int i = 0; i < count; i++) {
+            ret[i] = (targets[i] != nullptr)
+                   ? index.find(targets[i]->getData()) : nullptr;
+        }
+    } else if (concurrent) {
+        EpochGuard pin;
+        search(targets, count, ret);
+    } else {
+        search(targets, count, ret);
+    }
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        found += (ret[i] != nullptr);
+    }
+    STAT_ADD(retrieves, count);
+    STAT_ADD(retrieveVisits, opVisits);
+    STAT_ADD(retrieveCompares, opCompares);
+    return found;
 }
 
-bool BinTree::retrieve(
-    const Node* n, const NodeData& target, NodeData*& ret) const {
-    if (n == nullptr) {
-        // not found.
-        ret = nullptr; // so ret is not junk/ prev search destination
+int BinTree::insertBatch(NodeData* const nds[], int count, bool inserted[]) {
+    NodeData* found[BATCH_GROUP];
+    int total = 0;
+    for (int base = 0; base < count; base += BATCH_GROUP) {
+        int group = min(BATCH_GROUP, count - base);
+        if (indexed) {
+            // insert checks the index itself, so there is nothing to warm.
+            fill(found, found + group, nullptr);
+        } else if (concurrent) {
+            EpochGuard pin;
+            search(nds + base, group, found);
+        } else {
+            search(nds + base, group, found);
+        }
+
+        // the paths are in cache now. insert in order, as one by one would.
+        for (int i = 0; i < group; i++) {
+            bool ok = false;
+            if (found[i] == nullptr) {
+                ok = insert(nds[base + i]);
+            } else {
+                STAT_ADD(inserts, 1);
+                STAT_ADD(duplicates, 1);
+            }
+            if (inserted != nullptr) {
+                inserted[base + i] = ok;
+            }
+            total += ok;
+        }
+    }
+    return total;
+}
+
+void BinTree::search(const NodeData* const targets[], int count,
+                     NodeData* ret[]) const {
+    const Node* at[BATCH_GROUP];   // where each target is, nullptr if done
+    uint64_t prefix[BATCH_GROUP];  // each target's key prefix
+    bool tied[BATCH_GROUP];        // true if its NodeData was prefetched
+    for (int base = 0; base < count; base += BATCH_GROUP) {
+        int group = min(BATCH_GROUP, count - base);
+        const Node* top = load(root);
+        int active = 0;
+        for (int i = 0; i < group; i++) {
+            ret[base + i] = nullptr;
+            at[i] = (targets[base + i] != nullptr) ? top : nullptr;
+            if (at[i] != nullptr) {
+                prefix[i] = targets[base + i]->prefix();
+                tied[i] = false;
+                active++;
+            }
+        }
+
+        // each round takes every unfinished target one step, touching only
+        // memory prefetched in the round before.
+        while (active > 0) {
+            for (int i = 0; i < group; i++) {
+                const Node* n = at[i];
+                if (n == nullptr) continue;
+
+                if (!tied[i] && prefix[i] == n->prefix) {
+                    // the NodeData decides. fetch it and compare next round.
+                    prefetch(n->data);
+                    tied[i] = true;
+                    continue;
+                }
+                tied[i] = false;
+                int c = compareTo(*targets[base + i], prefix[i], n);
+                if (c == 0) {
+                    ret[base + i] = n->data;
+                    n = nullptr;
+                } else {
+                    n = load((c < 0) ? n->left : n->right);
+                }
+                if (n != nullptr) {
+                    prefetch(n);
+                } else {
+                    active--;
+                }
+                at[i] = n;
+            }
+        }
+    }
+}
+
+bool BinTree::find(string_view key, NodeData*& ret) const {
+    uint64_t prefix = NodeData::prefixOf(key);
+    for (const Node* n = load(root); n != nullptr;) {
+        int c = compareTo(key, prefix, n);
+        if (c == 0) {
+            ret = n->data;
+            return true;
+        }
+        n = load((c < 0) ? n->left : n->right);
+    }
+    ret = nullptr;
+    return false;
+}
+
+bool BinTree::erase(const NodeData& target) {
+    NodeData* ret;
+    return erase(target, ret, false);
+}
+
+bool BinTree::erase(const NodeData& target, NodeData*& ret) {
+    ret = nullptr;
+    return erase(target, ret, true);
+}
+
+bool BinTree::erase(const NodeData& target, NodeData*& ret, bool keepND) {
+    NodeData* found;
+    if (persistent && !retrieve(target, found)) {
+        return false; // don't copy a path just to find nothing
+    }
+    // unindex first: the NodeData may be deleted on the way out.
+    if (indexed && !index.erase(target.getData())) {
         return false;
-    } else if (target == *n->data) {
-        // found.
-        ret = n->data;
-        return true;
+    }
+    bool erased = erase(target, target.prefix(), root, ret, keepND);
+    if (concurrent) {
+        reclaim();
+    }
+    return erased;
+}
+
+bool BinTree::erase(const NodeData& target, uint64_t prefix, Node*& n,
+                    NodeData*& ret, bool keepND) {
+    // links to each Node on the way down. unlink calls removeMin, which
+    // keeps its own.
+    thread_local vector<Node**> path;
+    path.clear();
+    Node** link = &n;
+    while (true) {
+        if (*link == nullptr) {
+            return false;
+        }
+        own(*link);
+        int c = compareTo(target, prefix, *link);
+        if (c == 0) {
+            break;
+        }
+        path.push_back(link);
+        link = (c < 0) ? &(*link)->left : &(*link)->right;
+    }
+    ret = (*link)->data;
+    unlink(*link, keepND);
+    if (*link != nullptr) {
+        path.push_back(link); // whatever took the Node's place
+    }
+    retrace(path);
+    return true;
+}
+
+void BinTree::unlink(Node*& n, bool keepND) {
+    if (n->left == nullptr || n->right == nullptr) {
+        // zero or one child: it takes n's place.
+        Node* old = n;
+        publish(n, (n->left != nullptr) ? n->left : n->right);
+        discard(old, keepND);
+        return;
+    }
+
+    // two children: n takes over its successor's NodeData instead, and the
+    // successor's Node goes. readers may be on n, so in concurrent mode
+    // a copy holding the successor is published before it is removed below.
+    Node** link = &n->right;
+    own(*link);
+    while ((*link)->left != nullptr) {
+        link = &(*link)->left;
+        own(*link); // removeMin will change it, and its NodeData moves
+    }
+    const Node* succ = *link;
+    Node* old = n;
+    Node* next = concurrent ? clone(n) : n;
+    NodeData* gone = n->data;
+    attach(next, succ->data);
+    if (concurrent) {
+        publish(n, next);
+        retire(old, false, keepND);
+    } else if (!keepND) {
+        delete gone;
+    }
+    removeMin(next->right);
+}
+
+void BinTree::removeMin(Node*& n) {
+    thread_local vector<Node**> path;
+    path.clear();
+    Node** link = &n;
+    while ((*link)->left != nullptr) {
+        path.push_back(link);
+        link = &(*link)->left;
+    }
+    Node* old = *link;
+    publish(*link, old->right);
+    discard(old, true); // its NodeData moved up the tree
+    retrace(path);
+}
+
+void BinTree::discard(Node* n, bool keepND) {
+    if (concurrent) {
+        retire(n, false, keepND);
+        return;
+    }
+    if (!keepND) {
+        delete n->data;
+    }
+    freeNode(n);
+}
+
+bool BinTree::retrieve(const NodeData& target, NodeData*& ret) const {
+    STAT_BEGIN();
+    bool found = false;
+    if (indexed) {
+        ret = index.find(target.getData());
+        found = (ret != nullptr);
+    } else if (concurrent) {
+        // no locks: pin the epoch so nothing we walk over is freed.
+        EpochGuard pin;
+        found = retrieve(load(root), target, target.prefix(), ret);
+    } else if (balance == SPLAY && !persistent && !isEmpty()) {
+        // splaying moves Nodes but keeps the contents, so this stays const
+        // as far as callers can tell.
+        BinTree* self = const_cast<BinTree*>(this);
+        self->splay(self->root, target, target.prefix(), ret);
+        found = (ret != nullptr);
+    } else if (!isEmpty()) {
+        retrieve(root, target, target.prefix(), ret);
+        found = (ret != nullptr);
+    }
+    STAT_END(retrieve);
+    return found;
+}
+
+bool BinTree::retrieve(const Node* n, const NodeData& target, uint64_t prefix,
+                       NodeData*& ret) const {
+    // perform binary search iteratively through tree.
+    while (n != nullptr) {
+        int c = compareTo(target, prefix, n);
+        if (c == 0) {
+            // found.
+            ret = n->data;
+            return true;
+        }
+        n = load((c < 0) ? n->left : n->right);
     }
 
-    // perform binary search recursively through tree.
-    Node* next = (target < *n->data) ? n->left : n->right;
-    return retrieve(next, target, ret);
+    // not found.
+    ret = nullptr; // so ret is not junk/ prev search destination
+    return false;
 }
 
-int BinTree::getDepth(const NodeData& target) const {
-    return getDepth(root, target);
+int BinTree::getDepth(const NodeData& target, bool assumeBST) const {
+    if (!assumeBST) {
+        return getDepth(root, target);
+    }
+    uint64_t prefix = target.prefix();
+    int depth = 1;
+    for (const Node* n = root; n != nullptr; depth++) {
+        int c = compareTo(target, prefix, n);
+        if (c == 0) {
+            return depth;
+        }
+        n = (c < 0) ? n->left : n->right;
+    }
+    return 0;
 }
 
 int BinTree::getDepth(const Node* n, const NodeData& target) const {
-    if (n == nullptr) {
-        return 0;
+    // pre-order, left first, with a stack: a splayed tree may be too deep
+    // to recurse.
+    vector<pair<const Node*, int>> stack; // Node, its depth
+    if (n != nullptr) stack.push_back({n, 1});
+    while (!stack.empty()) {
+        auto [c, depth] = stack.back();
+        stack.pop_back();
+        if (target == *c->data) {
+            return depth;
+        }
+        if (c->right != nullptr) stack.push_back({c->right, depth + 1});
+        if (c->left != nullptr) stack.push_back({c->left, depth + 1});
+    }
+    return 0;
+}
+
+int BinTree::size() const {
+    return sizeOf(load(root));
+}
+
+int BinTree::rank(const NodeData& target) const {
+    int less = 0;
+    for (const Node* n = root; n != nullptr;) {
+        if (*n->data < target) {
+            // this Node and its whole left subtree are smaller.
+            less += sizeOf(n->left) + 1;
+            n = n->right;
+        } else {
+            n = n->left;
+        }
+    }
+    return less;
+}
+
+NodeData* BinTree::select(int k) const {
+    const Node* n = root;
+    while (n != nullptr) {
+        int left = sizeOf(n->left);
+        if (k < left) {
+            n = n->left;
+        } else if (k == left) {
+            return n->data;
+        } else {
+            k -= left + 1;
+            n = n->right;
+        }
     }
-    if (target == *n->data) {
-        return 1;
+    return nullptr;
+}
+
+BinTree::Stats BinTree::stats() const {
+    Stats s;
+#ifdef BINTREE_STATS
+    s.counted = true;
+    s.inserts = counters.inserts.load(memory_order_relaxed);
+    s.duplicates = counters.duplicates.load(memory_order_relaxed);
+    s.insertVisits = counters.insertVisits.load(memory_order_relaxed);
+    s.insertCompares = counters.insertCompares.load(memory_order_relaxed);
+    s.retrieves = counters.retrieves.load(memory_order_relaxed);
+    s.retrieveVisits = counters.retrieveVisits.load(memory_order_relaxed);
+    s.retrieveCompares = counters.retrieveCompares.load(memory_order_relaxed);
+    s.allocations = counters.allocations.load(memory_order_relaxed);
+    s.frees = counters.frees.load(memory_order_relaxed);
+#endif
+    if (concurrent) {
+        EpochGuard pin;
+        histogram(load(root), 0, s.depths);
+    } else {
+        histogram(root, 0, s.depths);
+    }
+    s.height = static_cast<int>(s.depths.size());
+    for (uint64_t count : s.depths) {
+        s.size += static_cast<int>(count);
     }
+    return s;
+}
 
-    int depth = getDepth(n->left, target);
-    if (depth > 0) {
-        return ++depth;
+void BinTree::histogram(const Node* n, int depth,
+                        vector<uint64_t>& depths) const {
+    // walk with a stack: the degenerate trees stats exists to catch are
+    // the ones too deep to recurse.
+    vector<pair<const Node*, int>> stack; // Node, its depth
+    if (n != nullptr) stack.push_back({n, depth});
+    while (!stack.empty()) {
+        auto [c, d] = stack.back();
+        stack.pop_back();
+        if (d == static_cast<int>(depths.size())) {
+            depths.push_back(0);
+        }
+        depths[d]++;
+        if (const Node* r = load(c->right)) stack.push_back({r, d + 1});
+        if (const Node* l = load(c->left)) stack.push_back({l, d + 1});
     }
-    depth = getDepth(n->right, target);
-    if (depth > 0) {
-        return ++depth;
+}
+
+void BinTree::resetStats() {
+#ifdef BINTREE_STATS
+    for (atomic<uint64_t>* c : {&counters.inserts, &counters.duplicates,
+                                &counters.insertVisits,
+                                &counters.insertCompares, &counters.retrieves,
+                                &counters.retrieveVisits,
+                                &counters.retrieveCompares,
+                                &counters.allocations, &counters.frees}) {
+        c->store(0, memory_order_relaxed);
     }
+#endif
+}
+
+string BinTree::Stats::toString() const {
+    string out;
+    auto line = [&out](const string& name, uint64_t value) {
+        out += name + " " + to_string(value) + "\n";
+    };
+    line("counted", counted);
+    line("inserts", inserts);
+    line("duplicates", duplicates);
+    line("insert_visits", insertVisits);
+    line("insert_compares", insertCompares);
+    line("retrieves", retrieves);
+    line("retrieve_visits", retrieveVisits);
+    line("retrieve_compares", retrieveCompares);
+    line("allocations", allocations);
+    line("frees", frees);
+    line("size", size);
+    line("height", height);
+    for (size_t d = 0; d < depths.size(); d++) {
+        line("depth." + to_string(d), depths[d]);
+    }
+    return out;
 }
 
 void BinTree::bstreeToArray(NodeData * arr[]) {
+    if (persistent) {
+        unshare(root); // hand out only NodeData no other tree has
+    }
     int* i = new int(0);
     bstreeToArray(root, arr, *i);
     delete i;
@@ -188,25 +1352,147 @@ void BinTree::bstreeToArray(NodeData * arr[]) {
 }
 
 void BinTree::bstreeToArray(Node* n, NodeData * arr[], int & i) {
-    if (n == nullptr) return;
-
-    bstreeToArray(n->left, arr, i);
-    arr[i++] = n->data;
-    bstreeToArray(n->right, arr, i);
+    vector<NodeData*> sorted;
+    sorted.reserve(sizeOf(n));
+    collect(n, sorted);
+    for (NodeData* nd : sorted) {
+        arr[i++] = nd;
+    }
 }
 
 void BinTree::arrayToBSTree(NodeData * arr[]) {
-    int lo = 0;
-    int hi = findHi(arr); // last ELEMENT (aka length-1)
-    if (hi - lo <= 0) {
+    if (arr[0] == nullptr) {
         cout << "! -- Array is empty. Can't convert! -- !" << endl;
         return;
     }
+    arrayToBSTree(arr, findHi(arr) + 1); // findHi is last ELEMENT
+}
+
+void BinTree::arrayToBSTree(NodeData* arr[], int n) {
+    if (concurrent) {
+        // build beside the old tree rather than recycling its Nodes.
+        Node* fresh = (n > 0) ? newNode() : nullptr;
+        arrayToBSTree(arr, fresh, 0, n - 1);
+        replaceRoot(fresh);
+        return;
+    }
+    if (persistent) {
+        pluck(root); // our Nodes may be shared, so don't recycle them
+    }
+    if (n > 0 && root == nullptr) {
+        root = newNode();
+    }
+    arrayToBSTree(arr, root, 0, n - 1);
+    if (indexed) {
+        reindex();
+    }
+}
+
+void BinTree::arrayToBSTree(vector<NodeData*>& arr) {
+    arrayToBSTree(arr.data(), static_cast<int>(arr.size()));
+    arr.clear();
+}
+
+void BinTree::bstreeToArray(vector<NodeData*>& arr) {
+    if (persistent) {
+        unshare(root); // hand out only NodeData no other tree has
+    }
+    collect(root, arr);
+    makeEmpty(true);
+}
+
+void BinTree::collect(const Node* n, vector<NodeData*>& arr) const {
+    // walk with a stack: a splayed tree may be too deep to recurse.
+    vector<const Node*> stack; // Nodes whose left subtree is being collected
+    stack.reserve(height(n));
+    while (n != nullptr || !stack.empty()) {
+        while (n != nullptr) {
+            stack.push_back(n);
+            n = n->left;
+        }
+        n = stack.back();
+        stack.pop_back();
+        arr.push_back(n->data);
+        n = n->right;
+    }
+}
+
+FrozenTree BinTree::freeze() const {
+    vector<NodeData*> sorted;
+    collect(root, sorted);
+    return FrozenTree(sorted);
+}
+
+void BinTree::bulkLoad(vector<NodeData*>& arr, int threads) {
+    if (threads <= 0) {
+        threads = max(1, static_cast<int>(thread::hardware_concurrency()));
+    }
+
+    // existing data goes first so it wins ties against the new batch.
+    // in concurrent mode readers keep the old tree until the new one is
+    // published, so collect its NodeData without emptying it.
+    vector<NodeData*> all;
+    Node* old = nullptr;
+    if (concurrent) {
+        collect(root, all);
+        old = root;
+    } else {
+        bstreeToArray(all);
+    }
+    for (NodeData* nd : arr) {
+        if (nd != nullptr) all.push_back(nd);
+    }
+    parallelSort(all, threads);
+
+    // keep the first of each run of equal keys, hand the rest back.
+    arr.clear();
+    int kept = 0;
+    for (NodeData* nd : all) {
+        if (kept > 0 && *nd == *all[kept - 1]) {
+            arr.push_back(nd);
+        } else {
+            all[kept++] = nd;
+        }
+    }
+    if (kept == 0) return;
+
+    // one Node per element up front, so builder threads never allocate.
+    int spawns = 0;
+    while ((1 << spawns) < threads) spawns++;
+    Node* block = pool->allocateBlock(kept);
+    STAT_ADD(allocations, kept);
+    publish(root, buildBalanced(all.data(), block, 0, kept - 1, spawns));
+    if (concurrent) {
+        retire(old, true, true); // the new Nodes hold its NodeData now
+        reclaim();
+    }
+    if (indexed) {
+        reindex();
+    }
+}
+
+BinTree::Node* BinTree::buildBalanced(NodeData* arr[], Node* block, int lo,
+                                      int hi, int spawns) {
+    if (hi < lo) return nullptr;
 
     int mid = lo + (hi - lo) / 2;
-    root = (root == nullptr) ? new Node : root;
-    arrayToBSTree(arr, root, lo, hi);
+    Node* n = &block[mid];
+    attach(n, arr[mid]);
+    arr[mid] = nullptr;
+    if (spawns > 0 && hi - lo >= PARALLEL_GRAIN) {
+        thread left([this, arr, block, lo, mid, n, spawns] {
+            n->left = buildBalanced(arr, block, lo, mid - 1, spawns - 1);
+        });
+        n->right = buildBalanced(arr, block, mid + 1, hi, spawns - 1);
+        left.join();
+    } else {
+        n->left = buildBalanced(arr, block, lo, mid - 1, 0);
+        n->right = buildBalanced(arr, block, mid + 1, hi, 0);
+    }
+    update(n);
+    return n;
 }
+
 void BinTree::arrayToBSTree(NodeData * arr[], Node*& n, int lo, int hi) {
     int mid = lo + (hi - lo) / 2;
     // base case
@@ -227,14 +1513,367 @@ void BinTree::arrayToBSTree(NodeData * arr[], Node*& n, int lo, int hi) {
         pluck(n->left);
     }
     delete n->data;     // delete pre-existing data, if any.
-    n->data = arr[mid]; // array transfers ownership of NodeData*
+    attach(n, arr[mid]); // array transfers ownership of NodeData*
     arr[mid] = nullptr;
 
     // continue until entire array is transferred. allocate if can't recycle.
-    n->left = (mid - 1 >= lo && n->left == nullptr) ? new Node() : n->left;
-    n->right = (mid + 1 <= hi && n->right == nullptr) ? new Node() : n->right;
+    n->left = (mid - 1 >= lo && n->left == nullptr) ? newNode() : n->left;
+    n->right = (mid + 1 <= hi && n->right == nullptr) ? newNode() : n->right;
     arrayToBSTree(arr, n->left, lo, mid - 1);
     arrayToBSTree(arr, n->right, mid + 1, hi);
+    update(n);
+}
+
+/** ===========================================================================
+    Split, join and set operations
+---------------------------------------------------------------------------- */
+NodeData* BinTree::split(const NodeData& key, BinTree& greater) {
+    if (&greater == this) return nullptr;
+
+    greater.makeEmpty();
+    greater.balance = balance;
+    if (persistent) {
+        greater.setPersistent(true); // it may get Nodes we share
+    }
+    if (greater.pool != pool) {
+        greater.pool->share(*pool);
+    }
+    Node* lo;
+    Node* match;
+    Node* hi;
+    split(workingCopy(), key, key.prefix(), lo, match, hi);
+    publish(greater.root, hi);
+    install(lo);
+    if (indexed) {
+        reindex();
+    }
+    if (greater.indexed) {
+        greater.reindex();
+    }
+
+    NodeData* found = nullptr;
+    if (match != nullptr) {
+        found = match->data;
+        pluck(match, true);
+    }
+    return found;
+}
+
+void BinTree::join(BinTree& rhs) {
+    if (&rhs == this || rhs.isEmpty()) return;
+
+    if (!isEmpty() && !(*select(size() - 1) < *rhs.select(0))) {
+        unionWith(rhs); // the key ranges overlap
+        return;
+    }
+    Node* mine = workingCopy();
+    Node* other = adopt(rhs);
+    install(join2(mine, other));
+    if (indexed) {
+        reindex();
+    }
+}
+
+void BinTree::unionWith(BinTree& rhs, int threads) {
+    if (&rhs == this) return;
+
+    vector<Node*> dead;
+    Node* mine = workingCopy();
+    Node* other = adopt(rhs);
+    install(unite(mine, other, dead, forkLevels(threads)), dead,
+            rhs.concurrent);
+    if (indexed) {
+        reindex();
+    }
+}
+
+void BinTree::intersectWith(BinTree& rhs, int threads) {
+    if (&rhs == this) return;
+
+    vector<Node*> dead;
+    Node* mine = workingCopy();
+    Node* other = adopt(rhs);
+    install(intersect(mine, other, dead, forkLevels(threads)), dead,
+            rhs.concurrent);
+    if (indexed) {
+        reindex();
+    }
+}
+
+void BinTree::differenceWith(BinTree& rhs, int threads) {
+    if (&rhs == this) {
+        makeEmpty();
+        return;
+    }
+
+    vector<Node*> dead;
+    Node* mine = workingCopy();
+    Node* other = adopt(rhs);
+    install(subtract(mine, other, dead, forkLevels(threads)), dead,
+            rhs.concurrent);
+    if (indexed) {
+        reindex();
+    }
+}
+
+BinTree::Node* BinTree::adopt(BinTree& rhs) {
+    if (rhs.persistent && !persistent) {
+        rhs.unshare(rhs.root); // we can't hold Nodes other trees share
+    }
+    if (rhs.pool != pool) {
+        pool->share(*rhs.pool);
+    }
+    Node* n = rhs.root;
+    publish(rhs.root, nullptr);
+    rhs.index.clear();
+    if (rhs.concurrent && n != nullptr) {
+        // rhs's readers may still be on its Nodes: take copies, and let rhs
+        // free the originals once they have moved on.
+        Node* old = n;
+        n = cloneSubtree(old);
+        rhs.retire(old, true, true);
+        rhs.reclaim();
+    }
+    return n;
+}
+
+BinTree::Node* BinTree::workingCopy() {
+    if (!concurrent) return root;
+
+    offline = true;
+    return cloneSubtree(root);
+}
+
+void BinTree::install(Node* result, const vector<Node*>& dead, bool shared) {
+    Node* old = root;
+    publish(root, result);
+    if (offline) {
+        offline = false;
+        retire(old, true, true); // its NodeData live on in the copies
+    }
+    for (Node* n : dead) {
+        if (concurrent || shared) {
+            retire(n, true, false); // readers may still compare against it
+        } else {
+            pluck(n);
+        }
+    }
+    reclaim();
+}
+
+int BinTree::forkLevels(int threads) const {
+    // copying shared Nodes or rotating in concurrent mode allocates.
+    if (persistent || (concurrent && !offline)) return 0;
+
+    if (threads <= 0) {
+        threads = max(1, static_cast<int>(thread::hardware_concurrency()));
+    }
+    int levels = 0;
+    while ((1 << levels) < threads) levels++;
+    return levels;
+}
+
+BinTree::Node* BinTree::join(Node* l, Node* k, Node* r) {
+    if (balance == AVL) {
+        if (height(l) > height(r) + 1) return joinRight(l, k, r);
+        if (height(r) > height(l) + 1) return joinLeft(l, k, r);
+    }
+    k->left = l;
+    k->right = r;
+    update(k);
+    return k;
+}
+
+BinTree::Node* BinTree::joinRight(Node* l, Node* k, Node* r) {
+    // l is taller: go down its right spine until the heights meet.
+    own(l);
+    Node* c = l->right;
+    if (height(c) <= height(r) + 1) {
+        k->left = c;
+        k->right = r;
+        update(k);
+        l->right = k;
+        if (height(k) > height(l->left) + 1) {
+            rotateRight(l->right);
+            update(l);
+            rotateLeft(l);
+        } else {
+            update(l);
+        }
+        return l;
+    }
+    l->right = joinRight(c, k, r);
+    update(l);
+    if (height(l->right) > height(l->left) + 1) {
+        rotateLeft(l);
+    }
+    return l;
+}
+
+BinTree::Node* BinTree::joinLeft(Node* l, Node* k, Node* r) {
+    // r is taller: the mirror image of joinRight.
+    own(r);
+    Node* c = r->left;
+    if (height(c) <= height(l) + 1) {
+        k->left = l;
+        k->right = c;
+        update(k);
+        r->left = k;
+        if (height(k) > height(r->right) + 1) {
+            rotateLeft(r->left);
+            update(r);
+            rotateRight(r);
+        } else {
+            update(r);
+        }
+        return r;
+    }
+    r->left = joinLeft(l, k, c);
+    update(r);
+    if (height(r->left) > height(r->right) + 1) {
+        rotateRight(r);
+    }
+    return r;
+}
+
+BinTree::Node* BinTree::join2(Node* l, Node* r) {
+    if (l == nullptr) return r;
+
+    Node* k;
+    Node* rest = splitLast(l, k);
+    return join(rest, k, r);
+}
+
+BinTree::Node* BinTree::splitLast(Node* n, Node*& last) {
+    own(n);
+    if (n->right == nullptr) {
+        last = n;
+        Node* l = n->left;
+        n->left = nullptr;
+        update(n);
+        return l;
+    }
+    Node* r = splitLast(n->right, last);
+    Node* l = n->left;
+    n->left = n->right = nullptr;
+    return join(l, n, r);
+}
+
+void BinTree::split(Node* n, const NodeData& key, uint64_t prefix, Node*& lo,
+                    Node*& match, Node*& hi) {
+    if (n == nullptr) {
+        lo = match = hi = nullptr;
+        return;
+    }
+    own(n);
+    int c = compareTo(key, prefix, n);
+    Node* l = n->left;
+    Node* r = n->right;
+    n->left = n->right = nullptr;
+    update(n);
+    if (c == 0) {
+        lo = l;
+        match = n;
+        hi = r;
+    } else if (c < 0) {
+        Node* between;
+        split(l, key, prefix, lo, match, between);
+        hi = join(between, n, r);
+    } else {
+        Node* between;
+        split(r, key, prefix, between, match, hi);
+        lo = join(l, n, between);
+    }
+}
+
+BinTree::Node* BinTree::unite(Node* a, Node* b, vector<Node*>& dead,
+                              int spawns) {
+    if (a == nullptr) return b;
+    if (b == nullptr) return a;
+
+    own(a);
+    Node* l2;
+    Node* m;
+    Node* r2;
+    split(b, *a->data, a->prefix, l2, m, r2);
+    if (m != nullptr) {
+        dead.push_back(m); // rhs's copy of a's NodeData
+    }
+    Node* l1 = a->left;
+    Node* r1 = a->right;
+    a->left = a->right = nullptr;
+    Node* l;
+    Node* r;
+    recurse(&BinTree::unite, l1, l2, r1, r2, l, r, dead, spawns);
+    return join(l, a, r);
+}
+
+BinTree::Node* BinTree::intersect(Node* a, Node* b, vector<Node*>& dead,
+                                  int spawns) {
+    if (a == nullptr || b == nullptr) {
+        if (a != nullptr) dead.push_back(a);
+        if (b != nullptr) dead.push_back(b);
+        return nullptr;
+    }
+
+    own(a);
+    Node* l2;
+    Node* m;
+    Node* r2;
+    split(b, *a->data, a->prefix, l2, m, r2);
+    Node* l1 = a->left;
+    Node* r1 = a->right;
+    a->left = a->right = nullptr;
+    Node* l;
+    Node* r;
+    recurse(&BinTree::intersect, l1, l2, r1, r2, l, r, dead, spawns);
+    if (m != nullptr) {
+        dead.push_back(m);
+        return join(l, a, r);
+    }
+    dead.push_back(a); // not in rhs
+    return join2(l, r);
+}
+
+BinTree::Node* BinTree::subtract(Node* a, Node* b, vector<Node*>& dead,
+                                 int spawns) {
+    if (a == nullptr || b == nullptr) {
+        if (b != nullptr) dead.push_back(b);
+        return a;
+    }
+
+    own(b);
+    Node* l1;
+    Node* m;
+    Node* r1;
+    split(a, *b->data, b->prefix, l1, m, r1);
+    if (m != nullptr) {
+        dead.push_back(m); // in rhs, so not in the result
+    }
+    Node* l2 = b->left;
+    Node* r2 = b->right;
+    b->left = b->right = nullptr;
+    dead.push_back(b);
+    Node* l;
+    Node* r;
+    recurse(&BinTree::subtract, l1, l2, r1, r2, l, r, dead, spawns);
+    return join2(l, r);
+}
+
+void BinTree::recurse(SetOp op, Node* l1, Node* l2, Node* r1, Node* r2,
+                      Node*& l, Node*& r, vector<Node*>& dead, int spawns) {
+    if (spawns > 0 && sizeOf(l1) + sizeOf(l2) >= PARALLEL_GRAIN) {
+        vector<Node*> leftDead;
+        thread left([this, op, l1, l2, &l, &leftDead, spawns] {
+            l = (this->*op)(l1, l2, leftDead, spawns - 1);
+        });
+        r = (this->*op)(r1, r2, dead, spawns - 1);
+        left.join();
+        dead.insert(dead.end(), leftDead.begin(), leftDead.end());
+    } else {
+        l = (this->*op)(l1, l2, dead, 0);
+        r = (this->*op)(r1, r2, dead, 0);
+    }
 }
 
 int BinTree::findHi(NodeData* arr[]) const {
@@ -246,28 +1885,278 @@ int BinTree::findHi(NodeData* arr[]) const {
 }
 
 
+/** ===========================================================================
+    Binary save/ load
+---------------------------------------------------------------------------- */
+static const char FILE_MAGIC[4] = {'B', 'T', 'R', 'E'};
+static const uint32_t FILE_VERSION = 1;
+static const int FILE_HEADER = 12; // magic, version, count
+
+// 32-bit little-endian, whatever the host order.
+static void put32(string& buf, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        buf.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+static uint32_t get32(const char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        v |= static_cast<uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+    return v;
+}
+
+bool BinTree::save(const string& path) const {
+    string buf(FILE_MAGIC, 4);
+    put32(buf, FILE_VERSION);
+    put32(buf, static_cast<uint32_t>(size()));
+    saveSubtree(root, buf);
+
+    ofstream out(path, ios::binary | ios::trunc);
+    out.write(buf.data(), buf.size());
+    return static_cast<bool>(out);
+}
+
+void BinTree::saveSubtree(const Node* n, string& buf) const {
+    vector<const Node*> stack; // right subtrees wait below left ones
+    if (n != nullptr) stack.push_back(n);
+    while (!stack.empty()) {
+        n = stack.back();
+        stack.pop_back();
+        const string& key = n->data->getData();
+        buf.push_back(static_cast<char>((n->left != nullptr ? 1 : 0) |
+                                        (n->right != nullptr ? 2 : 0)));
+        put32(buf, static_cast<uint32_t>(key.size()));
+        buf.append(key);
+        if (n->right != nullptr) stack.push_back(n->right);
+        if (n->left != nullptr) stack.push_back(n->left);
+    }
+}
+
+bool BinTree::load(const string& path) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < FILE_HEADER ||
+        memcmp(file.data(), FILE_MAGIC, 4) != 0 ||
+        get32(file.data() + 4) != FILE_VERSION) {
+        return false;
+    }
+    const char* p = file.data() + FILE_HEADER;
+    const char* end = file.data() + file.size();
+    uint32_t count = get32(file.data() + 8);
+    // every Node takes at least 5 bytes, which bounds a sane count.
+    if (count > static_cast<uint32_t>(end - p) / 5) {
+        return false;
+    }
+
+    // Nodes come in pre-order, so they are handed out in order from one block.
+    int n = static_cast<int>(count);
+    Node* block = (n > 0) ? pool->allocateBlock(n) : nullptr;
+    STAT_ADD(allocations, n);
+    Node* fresh = nullptr;
+    int next = 0;
+    bool ok = n == 0 || loadSubtree(p, end, block, next, n, fresh);
+    if (!ok || next != n || p != end) {
+        for (int i = 0; i < n; i++) {
+            delete block[i].data;
+            freeNode(&block[i]);
+        }
+        return false;
+    }
+
+    if (concurrent) {
+        replaceRoot(fresh);
+    } else {
+        pluck(root);
+        root = fresh;
+    }
+    if (indexed) {
+        reindex();
+    }
+    return true;
+}
+
+bool BinTree::loadSubtree(const char*& p, const char* end, Node* block,
+                          int& next, int count, Node*& n) {
+    // each slot still to fill, with the keys its Node must fall between
+    // (nullptr for no bound). right children wait below left ones.
+    struct Slot {
+        Node** link;
+        const NodeData* lo;
+        const NodeData* hi;
+    };
+    vector<Slot> stack{{&n, nullptr, nullptr}};
+    int first = next;
+    while (!stack.empty()) {
+        Slot s = stack.back();
+        stack.pop_back();
+        if (next == count || end - p < 5) return false;
+
+        int flags = static_cast<unsigned char>(*p);
+        uint32_t length = get32(p + 1);
+        p += 5;
+        if (length > static_cast<uint32_t>(end - p)) return false;
+
+        Node* fresh = &block[next++];
+        attach(fresh, new NodeData(string(p, length)));
+        p += length;
+        const NodeData* key = fresh->data;
+        if ((s.lo != nullptr && !(*s.lo < *key)) ||
+            (s.hi != nullptr && !(*key < *s.hi))) {
+            return false; // out of order, or a duplicate
+        }
+        *s.link = fresh;
+        if (flags & 2) stack.push_back({&fresh->right, key, s.hi});
+        if (flags & 1) stack.push_back({&fresh->left, s.lo, key});
+    }
+
+    // children come after their parent in pre-order, so a backward pass
+    // refreshes every Node after its children.
+    for (int i = next - 1; i >= first; i--) {
+        update(&block[i]);
+    }
+    return true;
+}
+
+/** ===========================================================================
+    Iterators
+---------------------------------------------------------------------------- */
+BinTree::Iterator BinTree::begin() const {
+    Iterator it(root);
+    it.pushLeftmost(root);
+    return it;
+}
+
+BinTree::Iterator BinTree::end() const {
+    return Iterator(root);
+}
+
+BinTree::Iterator BinTree::lower_bound(const NodeData& target) const {
+    return bound(target, false);
+}
+
+BinTree::Iterator BinTree::upper_bound(const NodeData& target) const {
+    return bound(target, true);
+}
+
+BinTree::Iterator BinTree::bound(const NodeData& target, bool strict) const {
+    Iterator it(root);
+    size_t keep = 0; // path length up to the best candidate so far
+    for (const Node* n = root; n != nullptr;) {
+        it.path.push_back(n);
+        bool past = strict ? (target < *n->data) : (target <= *n->data);
+        if (past) {
+            // candidate. anything better is smaller, to the left.
+            keep = it.path.size();
+            n = n->left;
+        } else {
+            n = n->right;
+        }
+    }
+    it.path.resize(keep);
+    return it;
+}
+
+BinTree::Range BinTree::range(const NodeData& lo, const NodeData& hi) const {
+    if (hi < lo) {
+        return Range{end(), end()};
+    }
+    return Range{lower_bound(lo), upper_bound(hi)};
+}
+
+void BinTree::Iterator::pushLeftmost(const Node* n) {
+    for (; n != nullptr; n = n->left) {
+        path.push_back(n);
+    }
+}
+
+void BinTree::Iterator::pushRightmost(const Node* n) {
+    for (; n != nullptr; n = n->right) {
+        path.push_back(n);
+    }
+}
+
+BinTree::Iterator& BinTree::Iterator::operator++() {
+    const Node* n = path.back();
+    if (n->right != nullptr) {
+        pushLeftmost(n->right);
+        return *this;
+    }
+    // climb until we leave a left subtree; its parent is next.
+    path.pop_back();
+    while (!path.empty() && path.back()->right == n) {
+        n = path.back();
+        path.pop_back();
+    }
+    return *this;
+}
+
+BinTree::Iterator& BinTree::Iterator::operator--() {
+    if (path.empty()) {
+        pushRightmost(root);
+        return *this;
+    }
+    const Node* n = path.back();
+    if (n->left != nullptr) {
+        pushRightmost(n->left);
+        return *this;
+    }
+    // climb until we leave a right subtree; its parent is previous.
+    path.pop_back();
+    while (!path.empty() && path.back()->left == n) {
+        n = path.back();
+        path.pop_back();
+    }
+    return *this;
+}
+
+bool BinTree::Iterator::operator==(const Iterator& rhs) const {
+    if (path.empty() || rhs.path.empty()) {
+        return path.empty() && rhs.path.empty();
+    }
+    return path.back() == rhs.path.back();
+}
+
 /** ===========================================================================
     Print functions
 ---------------------------------------------------------------------------- */
 
 void BinTree::displaySideways() const {
+    BufferedWriter w(cout);
+    displaySideways(w);
+    w.flush();
+}
+
+void BinTree::displaySideways(BufferedWriter& out) const {
     if (isEmpty()) {
-        cout << "! -- cannot display empty tree -- !" << endl;
+        out.write("! -- cannot display empty tree -- !\n");
     }
-    sideways(root, 0);
+    sideways(root, 0, out);
 }
 
-void BinTree::sideways(Node* current, int level) const {
-    if (current != nullptr) {
-        level++;
-        sideways(current->right, level);
+void BinTree::sideways(const Node* current, int level,
+                       BufferedWriter& out) const {
+    // right subtree, Node, then left subtree, with a stack: a splayed tree
+    // may be too deep to recurse.
+    vector<pair<const Node*, int>> stack; // Node, its level
+    stack.reserve(height(current));
+    level++;
+    while (current != nullptr || !stack.empty()) {
+        while (current != nullptr) {
+            stack.push_back({current, level});
+            current = current->right;
+            level++;
+        }
+        current = stack.back().first;
+        level = stack.back().second;
+        stack.pop_back();
 
         // indent for readability, 4 spaces per depth level 
-        for (int i = level; i >= 0; i--) {
-            cout << "    ";
-        }
+        out.fill(' ', 4 * (level + 1));
 
-        cout << *current->data << endl; // display information of object
-        sideways(current->left, level);
+        out.write(current->data->getData()); // display information of object
+        out.put('\n');
+        current = current->left;
+        level++;
     }
 }
\ No newline at end of file
@@ -4,13 +4,40 @@
 
     Assumptions:
     Duplicate data is ignored when building or inserting into a tree.
-    This class does not implement functions to remove individual nodes.
+    By default the tree is not self-balancing; setBalance(AVL) makes insert
+    rebalance by rotation so the height stays O(log n) for any input order.
+    setBalance(SPLAY) instead moves each key that insert or retrieve touches
+    toward the root, so keys looked up often are found in a few steps.
 
     Implementation tries to have as few memory allocations as possible,
     favoring the moving of pointers rather than allocating copies onto the
     heap, and copying a tree attempts to build on the tree that is already
     existing without initially clearing its memory.
-
+    Nodes come from a NodePool owned by the tree, so they sit in contiguous
+    chunks, removed nodes are recycled, and emptying the tree releases whole
+    chunks rather than individual nodes.
+
+    Thread safety:
+    By default a BinTree has none. In concurrent mode (setConcurrent) any
+    number of threads may call retrieve and isEmpty without locking while
+    one writer thread changes the tree. Writers publish child pointers
+    atomically and never change a Node a reader could be standing on;
+    replaced Nodes are reclaimed only after every reader that might have
+    seen them has finished (see epoch.h). insert may also be called by many
+    writer threads at once; every other modifying function still needs the
+    tree to itself.
+
+    Persistent mode (setPersistent) makes copying a tree O(1): the copy
+    shares the original's Nodes, which are reference counted, and whichever
+    tree changes a shared Node first copies it (and only the Nodes on the
+    path to it). Trees sharing Nodes also share one NodePool, so they must
+    not be used from different threads at the same time.
+
+    Indexed mode (setIndexed) keeps a hash index beside the tree from each
+    key to its NodeData, so retrieve finds a key in O(1) without descending
+    the tree, while inorder, bstreeToArray and the other ordered functions
+    still walk the tree. Operations that rebuild the tree wholesale
+    rebuild the index with it in O(n).
 
     @author: Charlie Nguyen
     @version: 1.0
@@ -18,8 +45,19 @@
 #ifndef BINTREE_H
 #define BINTREE_H
 
+#include "bufferedwriter.h"
+#include "epoch.h"
+#include "frozentree.h"
+#include "hashindex.h"
 #include "nodedata.h"
+#include "nodepool.h"
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 class BinTree
 {
@@ -29,10 +67,94 @@ private:
     // Tree is composed of Node*s, which contain NodeData*s.
     struct Node {
         NodeData* data = nullptr;   // ptr to data obj
+        uint64_t prefix = 0;        // data->prefix(), checked before data
         Node* left = nullptr;		// ptr to left subtree
         Node* right = nullptr;	    // ptr to right subree
+        int height = 1;             // height of this subtree, leaf is 1
+        // filled in lazily by const calls, through atomic_ref.
+        mutable size_t hash = 0;    // structural hash of this subtree
+        mutable bool hashed = false;// true if hash is up to date
+        int size = 1;               // number of Nodes in this subtree
+        int refs = 1;               // trees/ Nodes pointing here; >1 if shared
     };
 public:
+    // Insertion strategies. AVL keeps every node's subtrees within 1 level
+    // of each other in height by rotating on the way back up from insert.
+    // SPLAY semi-splays: each insert or retrieve roughly halves the depth of
+    // the Node it reaches, with no balance guarantee for any one operation.
+    enum Balance { UNBALANCED, AVL, SPLAY };
+
+    /** =======================================================================
+        Bidirectional iterator over the tree's NodeData in sorted order.
+
+        It keeps the path from the root to its current Node, so stepping is
+        amortized O(1) and the iterator holds O(height) memory. end() is the
+        empty path; decrementing it moves to the largest element. Any change
+        to the tree invalidates its iterators.
+        -------------------------------------------------------------------- */
+    class Iterator {
+        friend class BinTree;
+    public:
+        typedef bidirectional_iterator_tag iterator_category;
+        typedef const NodeData value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const NodeData* pointer;
+        typedef const NodeData& reference;
+
+        Iterator() {}
+        const NodeData& operator*() const { return *path.back()->data; }
+        const NodeData* operator->() const { return path.back()->data; }
+        Iterator& operator++();
+        Iterator& operator--();
+        Iterator operator++(int) { Iterator it(*this); ++*this; return it; }
+        Iterator operator--(int) { Iterator it(*this); --*this; return it; }
+        bool operator==(const Iterator& rhs) const;
+        bool operator!=(const Iterator& rhs) const { return !(*this == rhs); }
+
+    private:
+        const Node* root = nullptr;  // needed to step back from end()
+        vector<const Node*> path;    // root to current Node, empty at end()
+
+        Iterator(const Node* root) : root(root) {}
+        void pushLeftmost(const Node* n);
+        void pushRightmost(const Node* n);
+    };
+
+    // A pair of iterators usable in a range-based for loop.
+    struct Range {
+        Iterator first;
+        Iterator last;
+        Iterator begin() const { return first; }
+        Iterator end() const { return last; }
+    };
+
+    // What stats() reports. The operation counters are only kept when the
+    // tree is compiled with BINTREE_STATS defined, and are 0 otherwise; the
+    // shape of the tree is measured on every call either way.
+    struct Stats {
+        bool counted = false;       // true if built with BINTREE_STATS
+        uint64_t inserts = 0;       // insert calls (emplace included)
+        uint64_t duplicates = 0;    // of which rejected as duplicates
+        uint64_t insertVisits = 0;  // Nodes visited by those inserts
+        uint64_t insertCompares = 0;// NodeData compares (prefix ties) in them
+        uint64_t retrieves = 0;     // retrieve calls
+        uint64_t retrieveVisits = 0;   // Nodes visited by those retrieves
+        uint64_t retrieveCompares = 0; // NodeData compares in them
+        uint64_t allocations = 0;   // Nodes allocated
+        uint64_t frees = 0;         // Nodes freed
+        int size = 0;               // Nodes in the tree now
+        int height = 0;             // levels in the tree now, 0 if empty
+        vector<uint64_t> depths;    // [d] = Nodes d levels below the root
+
+        /** ===================================================================
+            Formats the stats one "name value" pair per line, with one
+            "depth.<d> <count>" line per histogram entry.
+
+            @return the text.
+            ---------------------------------------------------------------- */
+        string toString() const;
+    };
+
     /** =======================================================================
         Default constructor with an optional parameter.
 
@@ -61,7 +183,8 @@ public:
 
     /** =======================================================================
         A function that returns all allocated memory (Node and NodeData) of 
-        the root and all its children back to the heap.
+        the root and all its children back to the heap. Nodes are released a
+        chunk at a time, so with keep set this is O(chunks) rather than O(n).
 
         This method also deletes the NodeData objects the Nodes point to
         unless the optional keepND parameter is set to true, in which case the
@@ -77,6 +200,9 @@ public:
         It attempts to allocate and deallocate as few resources as possible for
         maximum efficiency.
 
+        If rhs is in persistent mode (and this tree is not concurrent), this
+        tree shares its Nodes in O(1) instead, and becomes persistent too.
+
         @param rhs BinTree to be copied.
         -------------------------------------------------------------------- */
     BinTree& operator=(const BinTree& rhs);
@@ -88,6 +214,16 @@ public:
         This method does not assume that either tree is a Binary Search Tree,
         but both must be Binary Trees.
 
+        Each Node caches a hash of its subtree, computed the first time it is
+        needed and kept until the subtree changes. Unequal trees almost
+        always differ in hash and are told apart without a walk; equal trees
+        are still compared in full.
+
+        Although const, this fills the hash cache. Any number of threads may
+        compare (or diff) trees at once, but not while a writer changes
+        either tree, even in concurrent mode, where only retrieve and
+        isEmpty may run alongside writes.
+
         @param rhs BinTree to compare against for equality.
         @return true if equal, false otherwise.
         -------------------------------------------------------------------- */
@@ -101,15 +237,125 @@ public:
         -------------------------------------------------------------------- */
     bool operator!=(const BinTree& rhs) const;
 
+    /** =======================================================================
+        Finds where this tree differs from another, skipping every subtree
+        whose cached hash matches its counterpart's (such subtrees are taken
+        to be identical). A Node is reported when its NodeData differs from
+        the Node in the same position of rhs, when rhs has no Node there, or
+        when exactly one of them has a left (or right) child; the subtrees
+        below a reported Node are not searched further. Fills the hash
+        cache, with the same thread safety as operator==.
+
+        @param rhs BinTree to compare against.
+        @param out Appended with the NodeData of each differing Node, in LNR
+                   order. The tree keeps ownership.
+        -------------------------------------------------------------------- */
+    void diff(const BinTree& rhs, vector<NodeData*>& out) const;
+
     /** =======================================================================
         Performs a binary search to insert a Node containing NodeData into the
         tree, starting from the root and ignoring duplicates.
 
+        In concurrent mode this is safe to call from many threads at once.
+        Without balancing, threads descend without locks and link the new
+        Node in with a compare-and-swap; with AVL they take turns, since a
+        rotation touches several Nodes.
+
         @param nd NodeData to be inserted.
         @return true if successful, false otherwise.
         -------------------------------------------------------------------- */
     bool insert(NodeData* nd);
 
+    /** =======================================================================
+        Removes the Node containing the target in O(height), rebalancing on
+        the way back up if balancing is on. The Node goes back to the pool's
+        free list for the next insert to reuse.
+
+        The first version deletes the NodeData. The second hands it to the
+        caller instead; in concurrent mode, readers that started before the
+        erase may still be comparing against it, so it must outlive them.
+
+        @param target NodeData equal to the one to be removed.
+        @param ret The removed NodeData if found, nullptr otherwise.
+        @return true if found and removed, false otherwise.
+        -------------------------------------------------------------------- */
+    bool erase(const NodeData& target);
+    bool erase(const NodeData& target, NodeData*& ret);
+
+    /** =======================================================================
+        Selects how insert keeps the tree in shape. Existing nodes are not
+        restructured; the new strategy applies to subsequent inserts.
+
+        In SPLAY mode retrieve(const NodeData&, NodeData*&) restructures the
+        tree too, so it must not run alongside any other call on the same
+        tree, const or not. It reads without restructuring in concurrent and
+        persistent mode, where readers may share the Nodes; so do the
+        string_view retrieve and retrieveBatch.
+
+        @param b UNBALANCED for a plain BST descent, AVL to rebalance, SPLAY
+                 to move accessed Nodes toward the root.
+        -------------------------------------------------------------------- */
+    void setBalance(Balance b);
+
+    /** =======================================================================
+        @return the insertion strategy currently in use.
+        -------------------------------------------------------------------- */
+    Balance getBalance() const;
+
+    /** =======================================================================
+        Turns concurrent mode on or off. Must not be called while other
+        threads are using the tree. Turning it off frees every Node still
+        waiting on readers. Turning it on turns persistent and indexed mode
+        off.
+
+        @param on true to allow lock-free readers alongside one writer.
+        -------------------------------------------------------------------- */
+    void setConcurrent(bool on);
+
+    /** =======================================================================
+        @return true if the tree is in concurrent mode.
+        -------------------------------------------------------------------- */
+    bool isConcurrent() const;
+
+    /** =======================================================================
+        Turns persistent (copy-on-write) mode on or off. Copies of a
+        persistent tree share its Nodes until either side changes them, so
+        snapshots cost O(1) and each later insert or erase copies only the
+        O(height) Nodes on its path. Turning it off gives the tree its own
+        copy of every Node it still shares.
+
+        Persistent and concurrent mode cannot be combined: turning either one
+        on turns the other off. Turning it on also turns indexed mode off.
+
+        @param on true to share Nodes between copies.
+        -------------------------------------------------------------------- */
+    void setPersistent(bool on);
+
+    /** =======================================================================
+        @return true if the tree is in persistent mode.
+        -------------------------------------------------------------------- */
+    bool isPersistent() const;
+
+    /** =======================================================================
+        Turns indexed mode on or off. An indexed tree keeps a hash index from
+        each key to its NodeData, which retrieve, retrieveBatch and insert's
+        duplicate check use instead of descending the tree. insert and erase
+        update it in O(1); operator=, arrayToBSTree, bulkLoad, load, split,
+        join and the set operations rebuild it in O(n). Costs about 32 bytes
+        per key. In SPLAY mode an indexed retrieve no longer splays.
+
+        Indexed mode cannot be combined with persistent or concurrent mode:
+        turning it on turns them off, and turning either on turns it off.
+
+        @param on true to keep the index.
+        -------------------------------------------------------------------- */
+    void setIndexed(bool on);
+
+    /** =======================================================================
+        @return true if the tree is in indexed mode.
+        -------------------------------------------------------------------- */
+    bool isIndexed() const;
+
     /** =======================================================================
         Helper function for operator<< to print NodeData objects in LNR order.
 
@@ -117,6 +363,15 @@ public:
         -------------------------------------------------------------------- */
     void inorder(ostream& out) const;
 
+    /** =======================================================================
+        Prints NodeData objects in LNR order, each followed by a space,
+        through a caller's writer. Output goes out in chunks of the
+        writer's buffer size, so trees of any size print in bounded memory.
+
+        @param out The writer to print with. Not flushed.
+        -------------------------------------------------------------------- */
+    void inorder(BufferedWriter& out) const;
+
     /**
         Finds the corresponding NodeData* in the tree matching the target.
 
@@ -126,17 +381,110 @@ public:
         -------------------------------------------------------------------- */
     bool retrieve(const NodeData& target, NodeData*& ret) const;
 
+    /** =======================================================================
+        Finds the NodeData in the tree whose data matches a raw key, without
+        building a NodeData to compare against. Lock-free like retrieve in
+        concurrent mode.
+
+        @param key The data to search for.
+        @param ret The NodeData in the tree if found, nullptr otherwise.
+        @return true if found, false otherwise.
+        -------------------------------------------------------------------- */
+    bool retrieve(string_view key, NodeData*& ret) const;
+
+    /** =======================================================================
+        Inserts a new NodeData holding key, unless the key is already in the
+        tree, in which case nothing is allocated. Outside concurrent,
+        persistent, indexed and SPLAY mode this takes a single descent, the
+        NodeData being made only once the key's empty slot is reached.
+
+        @param key The data for the new NodeData.
+        @return true if inserted, false if it was a duplicate.
+        -------------------------------------------------------------------- */
+    bool emplace(string_view key);
+
+    /** =======================================================================
+        Looks up many targets at once, with the same results as calling
+        retrieve on each. Targets are walked down the tree in groups that
+        move one level per round: each round prefetches the Node every
+        target goes to next (or the NodeData it must be compared with), so
+        the group's cache misses overlap instead of following each other.
+
+        @param targets The NodeData to search for. nullptr finds nothing.
+        @param count The number of targets.
+        @param ret Set to the matching NodeData for each target, or nullptr.
+        @return the number of targets found.
+        -------------------------------------------------------------------- */
+    int retrieveBatch(const NodeData* const targets[], int count,
+                      NodeData* ret[]) const;
+
+    /** =======================================================================
+        Inserts many NodeData, with the same results as calling insert on
+        each in order. Each group's paths are first walked in lockstep as
+        in retrieveBatch, which warms the cache for the inserts that follow
+        and rejects keys already in the tree without a second descent.
+
+        @param nds The NodeData to be inserted. Rejected ones stay the
+                   caller's to delete.
+        @param count The number of NodeData.
+        @param inserted If not nullptr, set to whether each was inserted.
+        @return the number inserted.
+        -------------------------------------------------------------------- */
+    int insertBatch(NodeData* const nds[], int count,
+                    bool inserted[] = nullptr);
+
     /** =======================================================================
         Finds the depth of the Node in the tree containing the target.
 
-        This method does not assume the tree is a Binary Search Tree, and
-        therefore must search all nodes before determining whether or not a
-        match was found.
+        By default this method does not assume the tree is a Binary Search
+        Tree, and therefore must search all nodes before determining whether
+        or not a match was found. With assumeBST set it only follows the
+        target's search path, in O(height).
 
         @param target NodeData object to find depth of.
+        @param assumeBST true to search like retrieve. Default is false.
         @return depth of the tree. 0 is not found, 1 is root.
         -------------------------------------------------------------------- */
-    int getDepth(const NodeData& target) const;
+    int getDepth(const NodeData& target, bool assumeBST = false) const;
+
+    /** =======================================================================
+        @return the number of NodeData in the tree, in O(1).
+        -------------------------------------------------------------------- */
+    int size() const;
+
+    /** =======================================================================
+        Counts the elements smaller than the target in O(height). This is the
+        target's index in sorted order if it is in the tree.
+
+        @param target The NodeData to rank.
+        @return the number of elements less than target.
+        -------------------------------------------------------------------- */
+    int rank(const NodeData& target) const;
+
+    /** =======================================================================
+        Finds the element at a given index of the sorted order in O(height).
+
+        @param k The index, 0 for the smallest element.
+        @return the NodeData at index k, or nullptr if k is out of range. The
+                tree keeps ownership.
+        -------------------------------------------------------------------- */
+    NodeData* select(int k) const;
+
+    /** =======================================================================
+        Reports the operation counters accumulated since the tree was made
+        (or resetStats was called) along with its current height and depth
+        histogram, which take a walk over the whole tree. An operation's
+        counts are gathered per thread and added to the totals with relaxed
+        atomics when it ends, so they cost little in concurrent mode too.
+
+        @return the stats.
+        -------------------------------------------------------------------- */
+    Stats stats() const;
+
+    /** =======================================================================
+        Sets the operation counters back to 0.
+        -------------------------------------------------------------------- */
+    void resetStats();
 
     /** =======================================================================
         A routine that fills an array of NodeData* by using an in-order
@@ -169,40 +517,501 @@ public:
         -------------------------------------------------------------------- */
     void arrayToBSTree(NodeData* arr[]);
 
+    /** =======================================================================
+        Appends the tree's NodeData*s to a vector in sorted order, growing it
+        as needed. It leaves the tree empty.
+
+        Responsibility for freeing the memory of the NodeData*s is transferred
+        from the BinTree to the vector.
+
+        @param arr The vector to append to.
+        -------------------------------------------------------------------- */
+    void bstreeToArray(vector<NodeData*>& arr);
+
+    /** =======================================================================
+        Builds a balanced BinTree in O(n) from the first n elements of an
+        already sorted (assumed) array, replacing the tree's current contents
+        and leaving those elements nullptr. Same layout as arrayToBSTree(arr).
+
+        @param arr The sorted array to be converted to a BinTree.
+        @param n The number of elements in arr.
+        -------------------------------------------------------------------- */
+    void arrayToBSTree(NodeData* arr[], int n);
+
+    /** =======================================================================
+        Builds a balanced BinTree from an already sorted (assumed) vector,
+        replacing the tree's current contents and leaving the vector empty.
+
+        @param arr The sorted vector to be converted to a BinTree.
+        -------------------------------------------------------------------- */
+    void arrayToBSTree(vector<NodeData*>& arr);
+
+    /** =======================================================================
+        Adds a batch of unsorted NodeData*s to the tree with one sort instead
+        of one insert descent per element. The tree's existing contents are
+        merged in, and the result is rebuilt as a balanced tree.
+
+        Duplicates are ignored as with insert: the first occurrence (existing
+        tree data first, then input order) is kept. Rejected NodeData*s are
+        left in arr and remain the caller's to delete; all others are owned
+        by the BinTree. nullptr elements are dropped.
+
+        With more than one thread, the sort runs as a parallel merge sort and
+        the two halves of each subtree are built at the same time, down to a
+        grain size. The resulting tree is the same either way.
+
+        In concurrent mode the new tree is built beside the old one and
+        swapped in with one publish, so readers see either every old key
+        or the merged tree, never a tree in between.
+
+        @param arr The NodeData*s to add. Holds only rejects on return.
+        @param threads Number of threads to use, 0 for one per hardware
+                       thread. Default is 1.
+        -------------------------------------------------------------------- */
+    void bulkLoad(vector<NodeData*>& arr, int threads = 1);
+
+    /** =======================================================================
+        Splits the tree around a key in O(height): elements less than key
+        stay, elements greater than key move to greater, replacing its
+        contents. greater takes this tree's balancing (and persistent mode).
+
+        In concurrent mode readers may keep using both trees: the split runs
+        on a copy of this tree's Nodes, which costs O(n) more, and each tree
+        changes over with one publish. As with erase, readers that started
+        before may still be comparing against the NodeData returned.
+
+        @param key The key to split around.
+        @param greater The tree to receive the larger elements.
+        @return the NodeData equal to key, removed and handed to the caller,
+                or nullptr if there was none.
+        -------------------------------------------------------------------- */
+    NodeData* split(const NodeData& key, BinTree& greater);
+
+    /** =======================================================================
+        Appends every element of rhs, leaving it empty. When all of rhs is
+        greater than all of this tree this takes O(height) and no
+        comparisons beyond checking that; otherwise it falls back to
+        unionWith. In concurrent mode it works on copies, as the set
+        operations below do.
+
+        @param rhs The tree to append.
+        -------------------------------------------------------------------- */
+    void join(BinTree& rhs);
+
+    /** =======================================================================
+        Set operations built on split and join. Each consumes rhs, leaving
+        it empty: NodeData* are moved into this tree where the result keeps
+        them, and deleted otherwise. Where both trees hold an element, this
+        tree's NodeData is the one kept.
+
+        unionWith keeps every element in either tree, intersectWith those
+        in both, and differenceWith those in this tree but not rhs. For
+        trees of m <= n elements they take O(m log(n/m + 1)) with AVL
+        balancing, the result staying balanced.
+
+        The two halves of each step are independent, so with more than one
+        thread they run in parallel down to a grain size (not in persistent
+        mode, which still runs on one thread). The result is the same either
+        way.
+
+        Outside concurrent mode neither tree may be read while they run. A
+        tree in concurrent mode may be: its Nodes are copied, which costs
+        O(n + m) more, the result is swapped in with one publish, and the
+        old Nodes, and NodeData dropped from the result, are freed only
+        once readers have moved on.
+
+        @param rhs The other tree.
+        @param threads Number of threads to use, 0 for one per hardware
+                       thread. Default is 1.
+        -------------------------------------------------------------------- */
+    void unionWith(BinTree& rhs, int threads = 1);
+    void intersectWith(BinTree& rhs, int threads = 1);
+    void differenceWith(BinTree& rhs, int threads = 1);
+
+    /** =======================================================================
+        Takes a read-only snapshot of the tree laid out in one contiguous
+        array, for workloads that build once and then retrieve many times.
+        The tree keeps ownership of its NodeData; the snapshot is only valid
+        until the tree is next modified.
+
+        @return the snapshot.
+        -------------------------------------------------------------------- */
+    FrozenTree freeze() const;
+
+    /** =======================================================================
+        Writes the tree to a compact binary file that load can read back
+        with the same shape. Layout, all integers 32-bit little-endian:
+            "BTRE"  version (1)  number of Nodes
+            then per Node, in pre-order:
+            flags byte (1 = has left child, 2 = has right child)
+            key length  key bytes
+
+        @param path The file to write.
+        @return true if written, false on an I/O error.
+        -------------------------------------------------------------------- */
+    bool save(const string& path) const;
+
+    /** =======================================================================
+        Replaces the tree with one written by save, rebuilding it in a single
+        linear pass over a memory mapping of the file, with at most two
+        comparisons per key to check the keys are in search tree order. On
+        failure (missing or malformed file, or keys out of order) the tree
+        is unchanged.
+
+        @param path The file to read.
+        @return true if loaded, false otherwise.
+        -------------------------------------------------------------------- */
+    bool load(const string& path);
+
+    /** =======================================================================
+        Iterators to the smallest element and one past the largest.
+        -------------------------------------------------------------------- */
+    Iterator begin() const;
+    Iterator end() const;
+
+    /** =======================================================================
+        Finds the first element not less than (lower_bound) or greater than
+        (upper_bound) the target in O(height).
+
+        @param target The NodeData to compare against.
+        @return an iterator to the element, end() if there is none.
+        -------------------------------------------------------------------- */
+    Iterator lower_bound(const NodeData& target) const;
+    Iterator upper_bound(const NodeData& target) const;
+
+    /** =======================================================================
+        Selects every element from lo to hi, both inclusive, in sorted order.
+        Walking the result costs O(height + k) for k elements.
+
+        @param lo The smallest NodeData to include.
+        @param hi The largest NodeData to include.
+        @return the range, empty if lo > hi or nothing falls between.
+        -------------------------------------------------------------------- */
+    Range range(const NodeData& lo, const NodeData& hi) const;
+
     /** =======================================================================
         Gives a visual display of the tree, viewable by tilding your head to
         the left; hard coded displaying to standard output.
         -------------------------------------------------------------------- */
     void displaySideways() const; // prints tree. Tilt head to left.
 
+    /** =======================================================================
+        displaySideways through a caller's writer, e.g. to a file or a
+        descriptor, in bounded memory like inorder.
+
+        @param out The writer to print with. Not flushed.
+        -------------------------------------------------------------------- */
+    void displaySideways(BufferedWriter& out) const;
+
 private:
     Node* root = nullptr; // Root Node for entire BinTree
+    Balance balance = UNBALANCED; // insertion strategy
+    // storage for every Node in this tree, and in its persistent copies.
+    shared_ptr<NodePool<Node>> pool = make_shared<NodePool<Node>>();
+    bool concurrent = false;      // true if readers may run during writes
+    bool persistent = false;      // true if copies share Nodes
+    bool offline = false;         // true while working on a private copy
+    bool indexed = false;         // true if index is kept up to date
+    HashIndex index;              // key to NodeData, when indexed
+    mutex writeMutex;             // serializes concurrent inserters' writes
+
+    // Nodes unlinked in concurrent mode, waiting for readers to move on.
+    struct Retired {
+        Node* n;       // the unlinked Node
+        uint64_t tag;  // epoch it was unlinked in
+        bool subtree;  // true to free n's children along with it
+        bool keepND;   // true to leave the NodeData alone
+    };
+    vector<Retired> limbo; // oldest first
+
+#ifdef BINTREE_STATS
+    // running totals behind stats(), one add per operation.
+    struct Counters {
+        atomic<uint64_t> inserts{0};
+        atomic<uint64_t> duplicates{0};
+        atomic<uint64_t> insertVisits{0};
+        atomic<uint64_t> insertCompares{0};
+        atomic<uint64_t> retrieves{0};
+        atomic<uint64_t> retrieveVisits{0};
+        atomic<uint64_t> retrieveCompares{0};
+        atomic<uint64_t> allocations{0};
+        atomic<uint64_t> frees{0};
+    };
+    mutable Counters counters;
+#endif
 
     /** =======================================================================
         A helper function called by operator<< that prints the BinTree's
-        NodeData values in-order.
+        NodeData values in-order, walking with a stack.
 
         @param n The current node.
-        @param out The output stream to print the tree to.
+        @param out The writer to print the tree with.
         -------------------------------------------------------------------- */
-    void inorderHelper(Node* n, ostream& out) const;
+    void inorderHelper(const Node* n, BufferedWriter& out) const;
 
     /** =======================================================================
-        Recursively performs a binary search to insert a Node containing
-        NodeData into the tree, ignoring duplicates.
+        Performs a binary search to insert a Node containing NodeData into
+        the tree, ignoring duplicates, then retraces the path it took.
 
         @param nd NodeData to be inserted.
+        @param prefix nd->prefix().
+        @param n The current Node.
+        @return true if inserted, false otherwise.
+        -------------------------------------------------------------------- */
+    bool insert(NodeData* nd, uint64_t prefix, Node*& n);
+
+    /** =======================================================================
+        insert for a raw key, making its NodeData only if it is not a
+        duplicate. For emplace.
+
+        @param key The data for the new NodeData.
+        @param prefix NodeData::prefixOf(key).
         @param n The current Node.
         @return true if inserted, false otherwise.
         -------------------------------------------------------------------- */
-    bool insert(NodeData* nd, Node*& n);
+    bool insert(string_view key, uint64_t prefix, Node*& n);
+
+    /** =======================================================================
+        Fixes up each Node on a search path, bottom first, after a Node was
+        added or removed below it: refreshes its height and size and, in
+        AVL mode, rebalances it.
+
+        @param path Links to the Nodes on the path, the root's first.
+        -------------------------------------------------------------------- */
+    void retrace(const vector<Node**>& path);
+
+    /** =======================================================================
+        Inserts without balancing, alongside other threads doing the same.
+        Descends without locks and links the new Node in with a
+        compare-and-swap, carrying on down from whichever Node won if another
+        thread got there first. Sizes on the path are then incremented and
+        heights raised with atomic maximums; both only ever grow while
+        inserts run.
+
+        @param nd NodeData to be inserted.
+        @return true if inserted, false if a duplicate was found.
+        -------------------------------------------------------------------- */
+    bool insertShared(NodeData* nd);
 
     /** =======================================================================
-        A helper function that recursively deletes a Node and all its children.
+        Helper methods for erase. The first finds the target and reclaims
+        retired Nodes afterwards; the second searches for it, then
+        retraces the path it took.
+
+        @param target NodeData equal to the one to be removed.
+        @param prefix target.prefix().
+        @param n The current Node.
+        @param ret Set to the removed NodeData.
+        @param keepND true to hand the NodeData back rather than delete it.
+        @return true if found and removed, false otherwise.
+        -------------------------------------------------------------------- */
+    bool erase(const NodeData& target, NodeData*& ret, bool keepND);
+    bool erase(const NodeData& target, uint64_t prefix, Node*& n,
+               NodeData*& ret, bool keepND);
+
+    /** =======================================================================
+        Removes a Node from the tree. A Node with fewer than two children is
+        replaced by its child; otherwise it takes over its in-order
+        successor's NodeData and the successor's Node is removed instead.
+
+        @param n The Node, updated to point at whatever takes its place.
+        @param keepND true to leave n's NodeData alone.
+        -------------------------------------------------------------------- */
+    void unlink(Node*& n, bool keepND);
+
+    /** =======================================================================
+        Removes the leftmost Node of a subtree without deleting its NodeData,
+        then retraces the path to it.
+
+        @param n The root of the subtree, updated if the root itself goes.
+        -------------------------------------------------------------------- */
+    void removeMin(Node*& n);
+
+    /** =======================================================================
+        Frees an unlinked Node (and its NodeData unless keepND), deferring to
+        the reclaimer in concurrent mode.
+
+        @param n The unlinked Node.
+        @param keepND true to leave the NodeData alone.
+        -------------------------------------------------------------------- */
+    void discard(Node* n, bool keepND);
+
+    /** =======================================================================
+        Points a Node at its NodeData, caching the NodeData's key prefix.
+
+        @param n The Node.
+        @param nd The NodeData it now holds.
+        -------------------------------------------------------------------- */
+    static void attach(Node* n, NodeData* nd);
+
+    /** =======================================================================
+        Three-way comparison of a search key against a Node's NodeData. The
+        cached prefixes settle it unless they are equal, so the NodeData is
+        only dereferenced on a tie.
+
+        @param key The search key.
+        @param prefix The key's prefix.
+        @param n The Node to compare against.
+        @return negative, zero or positive as key is less than, equal to or
+                greater than n's NodeData.
+        -------------------------------------------------------------------- */
+    static int compareTo(const NodeData& key, uint64_t prefix, const Node* n);
+    static int compareTo(string_view key, uint64_t prefix, const Node* n);
+
+    /** =======================================================================
+        Returns the height of a subtree, treating nullptr as height 0.
+
+        @param n The root of the subtree.
+        @return the height of n.
+        -------------------------------------------------------------------- */
+    static int height(const Node* n);
+
+    /** =======================================================================
+        Returns the number of Nodes in a subtree, treating nullptr as 0.
+
+        @param n The root of the subtree.
+        @return the size of n.
+        -------------------------------------------------------------------- */
+    static int sizeOf(const Node* n);
+
+    /** =======================================================================
+        Recomputes a Node's cached height and size from its children, and
+        marks its cached hash stale. Must be called bottom-up whenever a
+        Node's children change.
+
+        @param n The Node to refresh.
+        -------------------------------------------------------------------- */
+    void update(Node* n);
+
+    /** =======================================================================
+        Rotates a subtree so its right child becomes its root (and vice versa
+        for rotateRight), preserving in-order sequence.
+
+        @param n The root of the subtree, updated to point at the new root.
+        -------------------------------------------------------------------- */
+    void rotateLeft(Node*& n);
+    void rotateRight(Node*& n);
+
+    /** =======================================================================
+        Restores the AVL property at n with a single or double rotation if its
+        subtrees differ in height by more than 1. Children must already be
+        balanced and have up to date heights.
+
+        @param n The root of the subtree, updated to point at the new root.
+        -------------------------------------------------------------------- */
+    void rebalance(Node*& n);
+
+    /** =======================================================================
+        Semi-splays target's search path in n's subtree. Two levels at a
+        time from the bottom, a zig-zig rotates the middle Node up and a
+        zig-zag lifts the lower one over both, so the Node reached ends up
+        about half as deep and Nodes already near the top are not rewritten.
+
+        @param n The root of the subtree, updated to point at the new root.
+        @param target The NodeData to search for.
+        @param prefix target.prefix().
+        @param ret The matching NodeData if found, nullptr otherwise.
+        -------------------------------------------------------------------- */
+    void splay(Node*& n, const NodeData& target, uint64_t prefix,
+               NodeData*& ret);
+
+    /** =======================================================================
+        Takes a Node from the tree's pool, or gives it back to be recycled.
+
+        @param n The Node being returned.
+        @return a blank Node.
+        -------------------------------------------------------------------- */
+    Node* newNode();
+    void freeNode(Node* n);
+
+    /** =======================================================================
+        Reads a child (or root) pointer that a concurrent writer may be
+        changing, or writes one so that readers see a fully built Node.
+
+        @param p The pointer field.
+        @param v The new value.
+        @return the value of the field.
+        -------------------------------------------------------------------- */
+    static Node* load(Node* const& p);
+    static void publish(Node*& p, Node* v);
+
+    /** =======================================================================
+        Allocates a copy of a Node sharing its NodeData and children. Used to
+        restructure the tree in concurrent mode without touching Nodes that
+        readers may be on.
+
+        @param n The Node to copy.
+        @return the copy.
+        -------------------------------------------------------------------- */
+    Node* clone(const Node* n);
+
+    /** =======================================================================
+        Copies a whole subtree, sharing its NodeData, without recursing.
+
+        @param n The root of the subtree.
+        @return the root of the copy.
+        -------------------------------------------------------------------- */
+    Node* cloneSubtree(const Node* n);
+
+    /** =======================================================================
+        Makes sure this tree is the only one pointing at a Node, replacing a
+        shared Node with a private copy (and its own copy of the NodeData)
+        that shares the children instead. Must be called on every Node on
+        the way down before one of its fields changes.
+
+        @param n The pointer to the Node, updated to point at the copy.
+        -------------------------------------------------------------------- */
+    void own(Node*& n);
+
+    /** =======================================================================
+        Recursively owns every Node of a subtree, so that none of it is
+        shared with another tree.
+
+        @param n The root of the subtree.
+        -------------------------------------------------------------------- */
+    void unshare(Node*& n);
+
+    /** =======================================================================
+        Hands an unlinked Node (or whole subtree) to the reclaimer.
+
+        @param n The unlinked Node.
+        @param subtree true to free n's children along with it.
+        @param keepND true to leave the NodeData alone.
+        -------------------------------------------------------------------- */
+    void retire(Node* n, bool subtree, bool keepND);
+
+    /** =======================================================================
+        Frees retired Nodes that no reader can reach any more.
+
+        @param force true to free everything, e.g. when no readers remain.
+        -------------------------------------------------------------------- */
+    void reclaim(bool force = false);
+
+    /** =======================================================================
+        Publishes a freshly built tree as the root and retires the old one
+        along with its NodeData. Used in concurrent mode by the operations
+        that would otherwise rebuild the tree in place.
+
+        @param fresh The root of the new tree.
+        -------------------------------------------------------------------- */
+    void replaceRoot(Node* fresh);
+
+    /** =======================================================================
+        Recursively deletes the NodeData of a subtree without freeing Nodes.
+        Used by makeEmpty before dropping the pool wholesale.
+
+        @param n The root of the subtree.
+        -------------------------------------------------------------------- */
+    void deleteData(Node* n);
+
+    /** =======================================================================
+        A helper function that deletes a Node and all its children, walking
+        with a stack.
 
         This method also deletes the NodeData objects the Nodes point to
         unless the optional keepND parameter is set to true, in which case the
         responsibility for deleting the NodeData is transferred to the caller.
+        A Node still shared with another tree is only let go of, not deleted.
 
         @param n The pointer to the Node to be deleted, removing all children.
         @param keepND if true, does not delete NodeData*. Default is false.
@@ -223,18 +1032,40 @@ private:
     void copySubtree(Node*& lhs, Node* rhs);
 
     /** =======================================================================
-        Helper function that recursively searches for the NodeData target.
+        Helper function that iteratively searches for the NodeData target.
 
         @param n The current node.
         @param target The node to be searched for.
+        @param prefix target.prefix().
         @param ret The pointer to the matching node, nullptr otherwise.
         @return true if found, false otherwise.
         -------------------------------------------------------------------- */
-    bool retrieve(const Node* n, const NodeData& target, NodeData*& ret) const;
+    bool retrieve(const Node* n, const NodeData& target, uint64_t prefix,
+                  NodeData*& ret) const;
+
+    /** =======================================================================
+        Helper method for retrieveBatch and insertBatch that searches for a
+        group of targets in lockstep, prefetching one level ahead.
+
+        @param targets The NodeData to search for.
+        @param count The number of targets.
+        @param ret Set to the matching NodeData for each target, or nullptr.
+        -------------------------------------------------------------------- */
+    void search(const NodeData* const targets[], int count,
+                NodeData* ret[]) const;
+
+    /** =======================================================================
+        Helper function that iteratively searches for a raw key.
+
+        @param key The data to search for.
+        @param ret The matching NodeData, nullptr otherwise.
+        @return true if found, false otherwise.
+        -------------------------------------------------------------------- */
+    bool find(string_view key, NodeData*& ret) const;
 
     /** =======================================================================
-        Helper method which recursively finds the depth of the Node containing
-        the target.
+        Helper method which finds the depth of the Node containing the
+        target, searching the whole subtree with a stack.
 
         @param n The current node being searched
         @param target NodeData to find the depth of
@@ -243,9 +1074,9 @@ private:
     int getDepth(const Node* n, const NodeData& target) const;
 
     /** =======================================================================
-        Helper method to recursively check if a tree is identical to its 
-        right-hand operand. Two BinTrees are equal when the relational order 
-        of their Nodes match exactly.
+        Helper method to check if a tree is identical to its right-hand
+        operand, pair by pair without recursing. Two BinTrees are equal when
+        the relational order of their Nodes match exactly.
         This method does not assume that either tree is a Binary Search Tree,
         but both must be Binary Trees.
 
@@ -256,8 +1087,28 @@ private:
     bool checkEqual(const Node* n, const Node* rhs) const;
 
     /** =======================================================================
-        Helper method that recursively fills an array of NodeData* by using an 
-        in-order traversal of the tree. It leaves the tree empty.
+        Returns the structural hash of a subtree, computing and caching it
+        from the children's hashes if the subtree changed since last time.
+        Stale hashes below are filled in bottom up without recursing.
+
+        @param n The root of the subtree.
+        @return the hash of n's NodeData and both children's hashes.
+        -------------------------------------------------------------------- */
+    size_t subtreeHash(const Node* n) const;
+
+    /** =======================================================================
+        Helper method for diff. Compares the trees pair by pair with a
+        stack, left before right, so out is in tree order.
+
+        @param n The current node of this tree.
+        @param rhs The node in the same position of the other tree.
+        @param out Appended with the NodeData of each differing Node.
+        -------------------------------------------------------------------- */
+    void diff(const Node* n, const Node* rhs, vector<NodeData*>& out) const;
+
+    /** =======================================================================
+        Helper method that fills an array of NodeData* by using an in-order
+        traversal of the tree (see collect). It leaves the tree empty.
 
         Responsibility for freeing the memory of the NodeData*s is transferred
         from the BinTree to the array.
@@ -271,12 +1122,202 @@ private:
         -------------------------------------------------------------------- */
     void bstreeToArray(Node* n, NodeData* arr[], int& i);
 
+    /** =======================================================================
+        Helper method that appends a subtree's NodeData*s to a vector in
+        in-order sequence, leaving the subtree untouched. Walks with a
+        stack, so trees of any height can be collected.
+
+        @param n The root of the subtree.
+        @param arr The vector to append to.
+        -------------------------------------------------------------------- */
+    void collect(const Node* n, vector<NodeData*>& arr) const;
+
+    /** =======================================================================
+        Helper method for save that appends a subtree's records in pre-order,
+        without recursing, so trees of any height can be saved.
+
+        @param n The root of the subtree.
+        @param buf The buffer to append to.
+        -------------------------------------------------------------------- */
+    void saveSubtree(const Node* n, string& buf) const;
+
+    /** =======================================================================
+        Helper method for load that rebuilds a subtree from its pre-order
+        records, taking Nodes from block in order. Works with a stack rather
+        than recursion, so no file can exhaust the call stack, and checks
+        each key against the bounds its position in the tree sets.
+
+        @param p The next record, advanced past the subtree.
+        @param end One past the last byte of the file.
+        @param block The Nodes to fill.
+        @param next The index of the next unused Node in block.
+        @param count The number of Nodes in block.
+        @param n Set to the root of the subtree.
+        @return true if the records were well formed and in order, false
+                otherwise.
+        -------------------------------------------------------------------- */
+    bool loadSubtree(const char*& p, const char* end, Node* block, int& next,
+                     int count, Node*& n);
+
+    /** =======================================================================
+        Helper method for lower_bound and upper_bound. Descends toward the
+        target, keeping the path to the last Node that passes the bound.
+
+        @param target The NodeData to compare against.
+        @param strict true to skip elements equal to target.
+        @return an iterator to the first element past the bound.
+        -------------------------------------------------------------------- */
+    Iterator bound(const NodeData& target, bool strict) const;
+
     /** =======================================================================
         A helper method to recursively build a balanced BinTree from an already
         sorted array (assumed), leaving the array filled with nullptrs.
         -------------------------------------------------------------------- */
     void arrayToBSTree(NodeData* arr[], Node*& n, int lo, int hi);
 
+    /** =======================================================================
+        Joins two subtrees with a Node between them, where everything in l is
+        less than k's NodeData and everything in r greater. With AVL
+        balancing, k is placed down the spine of the taller side where the
+        heights meet and the path is rebalanced, in O(height difference);
+        otherwise k simply becomes the root. joinRight and joinLeft are the
+        two descents.
+
+        @param l The smaller subtree.
+        @param k A detached Node holding the middle NodeData.
+        @param r The larger subtree.
+        @return the root of the joined subtree.
+        -------------------------------------------------------------------- */
+    Node* join(Node* l, Node* k, Node* r);
+    Node* joinRight(Node* l, Node* k, Node* r);
+    Node* joinLeft(Node* l, Node* k, Node* r);
+
+    /** =======================================================================
+        Joins two subtrees without a middle Node, by taking l's largest.
+
+        @param l The smaller subtree.
+        @param r The larger subtree.
+        @return the root of the joined subtree.
+        -------------------------------------------------------------------- */
+    Node* join2(Node* l, Node* r);
+
+    /** =======================================================================
+        Removes the largest Node of a subtree, detached from the rest.
+
+        @param n The root of the subtree.
+        @param last Set to the removed Node.
+        @return the root of what remains.
+        -------------------------------------------------------------------- */
+    Node* splitLast(Node* n, Node*& last);
+
+    /** =======================================================================
+        Splits a subtree around a key.
+
+        @param n The root of the subtree, which is taken apart.
+        @param key The key to split around.
+        @param prefix key.prefix().
+        @param lo Set to the subtree of elements less than key.
+        @param match Set to the detached Node equal to key, or nullptr.
+        @param hi Set to the subtree of elements greater than key.
+        -------------------------------------------------------------------- */
+    void split(Node* n, const NodeData& key, uint64_t prefix, Node*& lo,
+               Node*& match, Node*& hi);
+
+    /** =======================================================================
+        Helper methods for the set operations: split b around a's root (or
+        a around b's, for subtract), recurse on the two sides, and join the
+        results. Unwanted Nodes are detached and left in dead for the
+        caller to free, so that parallel branches never touch the pool.
+
+        @param a The root of this tree's subtree.
+        @param b The root of rhs's subtree.
+        @param dead Collects detached subtrees to be freed.
+        @param spawns How many more levels may fork a thread.
+        @return the root of the result.
+        -------------------------------------------------------------------- */
+    Node* unite(Node* a, Node* b, vector<Node*>& dead, int spawns);
+    Node* intersect(Node* a, Node* b, vector<Node*>& dead, int spawns);
+    Node* subtract(Node* a, Node* b, vector<Node*>& dead, int spawns);
+
+    /** =======================================================================
+        Runs a set operation helper on the left pair and the right pair of
+        subtrees, the left on a new thread if spawns allow and the pair is
+        big enough.
+
+        @param op The helper to run.
+        @param l1 this tree's left subtree, l2 rhs's.
+        @param r1 this tree's right subtree, r2 rhs's.
+        @param l Set to the left result.
+        @param r Set to the right result.
+        @param dead Collects detached subtrees to be freed.
+        @param spawns How many more levels may fork a thread.
+        -------------------------------------------------------------------- */
+    typedef Node* (BinTree::*SetOp)(Node*, Node*, vector<Node*>&, int);
+    void recurse(SetOp op, Node* l1, Node* l2, Node* r1, Node* r2, Node*& l,
+                 Node*& r, vector<Node*>& dead, int spawns);
+
+    /** =======================================================================
+        Takes every Node of rhs for use in this tree, leaving rhs empty.
+
+        @param rhs The tree to take from.
+        @return the root of rhs's former Nodes.
+        -------------------------------------------------------------------- */
+    Node* adopt(BinTree& rhs);
+
+    /** =======================================================================
+        Gives split, join and the set operations this tree's Nodes to
+        restructure in place. In concurrent mode, where readers may be on
+        them, that is a copy instead, and rotations stop copying Nodes
+        until install.
+
+        @return the root of the Nodes to work on.
+        -------------------------------------------------------------------- */
+    Node* workingCopy();
+
+    /** =======================================================================
+        Publishes the result of an operation begun with workingCopy. Nodes
+        readers may still be on, and NodeData they may still compare
+        against, are retired rather than freed.
+
+        @param result The new root.
+        @param dead Subtrees the result dropped, NodeData and all.
+        @param shared true if dead's NodeData came from a concurrent rhs.
+        -------------------------------------------------------------------- */
+    void install(Node* result, const vector<Node*>& dead = {},
+                 bool shared = false);
+
+    /** =======================================================================
+        Rebuilds the index from every NodeData in the tree, after an
+        operation that replaced the tree's contents wholesale.
+        -------------------------------------------------------------------- */
+    void reindex();
+
+    /** =======================================================================
+        Converts a thread count (0 for one per hardware thread) into how
+        many levels of a recursion may fork, none if the tree's Nodes can't
+        be changed from several threads at once.
+
+        @param threads The number of threads.
+        @return the number of levels.
+        -------------------------------------------------------------------- */
+    int forkLevels(int threads) const;
+
+    /** =======================================================================
+        A helper method for bulkLoad that builds a balanced subtree (laid out
+        as arrayToBSTree does) into pre-allocated Nodes, where arr[i] goes in
+        block[i]. Once a range is big enough, its left half is built on a
+        new thread while this one builds the right.
+
+        @param arr The sorted NodeData*s, left nullptr as they are taken.
+        @param block One blank Node per element of arr.
+        @param lo The first index of the subtree's range.
+        @param hi The last index of the subtree's range.
+        @param spawns How many more levels may fork a thread.
+        @return the root of the subtree.
+        -------------------------------------------------------------------- */
+    Node* buildBalanced(NodeData* arr[], Node* block, int lo, int hi,
+                        int spawns);
+
     /** =======================================================================
         A helper method to find the last element of an array of size 100.
         Unused elements are nullptr.
@@ -286,12 +1327,22 @@ private:
     int findHi(NodeData* arr[]) const;
 
     /** =======================================================================
-        A helper method to recursively give a visual display of the tree if
-        you were to tilt their head to the left.
+        Helper method for stats that counts the Nodes at each depth.
+
+        @param n The current Node.
+        @param depth Its number of levels below the root.
+        @param depths The histogram to add n's subtree to.
+        -------------------------------------------------------------------- */
+    void histogram(const Node* n, int depth, vector<uint64_t>& depths) const;
+
+    /** =======================================================================
+        A helper method to give a visual display of the tree if you were to
+        tilt their head to the left, walking with a stack.
 
         @param current The current Node
         @param level the current level(depth) of the tree, root is 0.
+        @param out The writer to print the tree with.
         -------------------------------------------------------------------- */
-    void sideways(Node* current, int level) const;
+    void sideways(const Node* current, int level, BufferedWriter& out) const;
 };
 #endif
\ No newline at end of file
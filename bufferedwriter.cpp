@@ -0,0 +1,72 @@
+#include "bufferedwriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+/** ===========================================================================
+    Constructors/ Destructors
+---------------------------------------------------------------------------- */
+BufferedWriter::BufferedWriter(ostream& out, size_t capacity)
+    : stream(&out), buf(new char[capacity]), capacity(capacity) {}
+
+BufferedWriter::BufferedWriter(int fd, size_t capacity)
+    : fd(fd), buf(new char[capacity]), capacity(capacity) {}
+
+BufferedWriter::~BufferedWriter() {
+    flush();
+}
+
+/** ===========================================================================
+    BufferedWriter Functions
+---------------------------------------------------------------------------- */
+void BufferedWriter::fill(char c, size_t count) {
+    while (count > 0) {
+        if (used == capacity) {
+            flush();
+        }
+        size_t n = min(count, capacity - used);
+        memset(buf.get() + used, c, n);
+        used += n;
+        count -= n;
+    }
+}
+
+bool BufferedWriter::flush() {
+    drain(buf.get(), used);
+    used = 0;
+    if (stream != nullptr) {
+        stream->flush();
+    }
+    return good();
+}
+
+bool BufferedWriter::good() const {
+    return (stream != nullptr) ? stream->good() : !failed;
+}
+
+void BufferedWriter::overflow(const char* s, size_t n) {
+    drain(buf.get(), used);
+    used = 0;
+    if (n < capacity) {
+        memcpy(buf.get(), s, n);
+        used = n;
+    } else {
+        drain(s, n); // no point copying it through the buffer
+    }
+}
+
+void BufferedWriter::drain(const char* s, size_t n) {
+    if (stream != nullptr) {
+        stream->write(s, n);
+        return;
+    }
+    while (n > 0 && !failed) {
+        ssize_t w = ::write(fd, s, n);
+        if (w < 0) {
+            failed = (errno != EINTR);
+            continue;
+        }
+        s += w;
+        n -= static_cast<size_t>(w);
+    }
+}
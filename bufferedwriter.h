@@ -0,0 +1,136 @@
+/** ===========================================================================
+    bufferedwriter.h
+    Purpose: collect small pieces of output in one buffer and hand them to
+    a stream or file descriptor in large chunks.
+
+    Writing a tree one element at a time through an ostream costs a virtual
+    call and a sentry per element, and a flush per line if the caller uses
+    endl. A BufferedWriter instead copies each piece into a fixed block of
+    memory and passes the block on only when it fills up, so dumping a
+    large tree takes a few large writes no matter how many elements it has,
+    and never more memory than the buffer.
+
+    Assumptions:
+    Output is passed on when the buffer fills, on flush, and on
+    destruction. Anything written to the same stream or descriptor by other
+    means in between comes out of order. For a descriptor, write errors
+    other than EINTR stop all further output, which good() then reports.
+
+    @author: Charlie Nguyen
+    @version: 1.0
+---------------------------------------------------------------------------- */
+#ifndef BUFFEREDWRITER_H
+#define BUFFEREDWRITER_H
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string_view>
+using namespace std;
+
+class BufferedWriter
+{
+public:
+    static const size_t DEFAULT_CAPACITY = 1 << 16;
+
+    /** =======================================================================
+        Constructor for output to a stream.
+
+        @param out The stream to write to. Must outlive the writer.
+        @param capacity Size of the buffer in bytes, at least 1.
+        -------------------------------------------------------------------- */
+    explicit BufferedWriter(ostream& out, size_t capacity = DEFAULT_CAPACITY);
+
+    /** =======================================================================
+        Constructor for output to a file descriptor, e.g. 1 for standard
+        output. The descriptor is not closed.
+
+        @param fd The descriptor to write to.
+        @param capacity Size of the buffer in bytes, at least 1.
+        -------------------------------------------------------------------- */
+    explicit BufferedWriter(int fd, size_t capacity = DEFAULT_CAPACITY);
+
+    /** =======================================================================
+        Destructor. Passes on whatever is still buffered.
+        -------------------------------------------------------------------- */
+    ~BufferedWriter();
+
+    // Copying is not supported.
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    /** =======================================================================
+        Appends bytes to the output.
+
+        @param s The bytes to append.
+        -------------------------------------------------------------------- */
+    void write(string_view s) {
+        if (s.size() <= capacity - used) {
+            memcpy(buf.get() + used, s.data(), s.size());
+            used += s.size();
+        } else {
+            overflow(s.data(), s.size());
+        }
+    }
+
+    /** =======================================================================
+        Appends one byte to the output.
+
+        @param c The byte to append.
+        -------------------------------------------------------------------- */
+    void put(char c) {
+        if (used == capacity) {
+            flush();
+        }
+        buf[used++] = c;
+    }
+
+    /** =======================================================================
+        Appends count copies of a byte to the output, e.g. for indenting.
+
+        @param c The byte to repeat.
+        @param count How many times.
+        -------------------------------------------------------------------- */
+    void fill(char c, size_t count);
+
+    /** =======================================================================
+        Passes everything buffered on to the stream or descriptor, and
+        flushes the stream.
+
+        @return true if all output so far has been written, false otherwise.
+        -------------------------------------------------------------------- */
+    bool flush();
+
+    /** =======================================================================
+        @return true if no write has failed so far, false otherwise.
+        -------------------------------------------------------------------- */
+    bool good() const;
+
+private:
+    ostream* stream = nullptr;   // where output goes, or nullptr to use fd
+    int fd = -1;                 // where output goes if stream is nullptr
+    unique_ptr<char[]> buf;      // output not yet passed on
+    size_t capacity;             // size of buf
+    size_t used = 0;             // bytes of buf in use
+    bool failed = false;         // true once a write to fd has failed
+
+    /** =======================================================================
+        Appends bytes that do not fit in what is left of the buffer: passes
+        the buffer on, then either buffers them or, if they would fill the
+        buffer anyway, passes them on directly.
+
+        @param s The first byte.
+        @param n The number of bytes.
+        -------------------------------------------------------------------- */
+    void overflow(const char* s, size_t n);
+
+    /** =======================================================================
+        Writes bytes to the stream or descriptor, retrying partial writes.
+
+        @param s The first byte.
+        @param n The number of bytes.
+        -------------------------------------------------------------------- */
+    void drain(const char* s, size_t n);
+};
+#endif
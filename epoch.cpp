@@ -0,0 +1,72 @@
+#include "epoch.h"
+#include <thread>
+
+// per-thread state: which slot is ours, and how deeply we are pinned.
+namespace {
+struct ThreadSlot {
+    std::atomic<bool>* claimed = nullptr;
+    void* slot = nullptr;
+    int depth = 0;
+    ~ThreadSlot() {
+        if (claimed != nullptr) claimed->store(false, std::memory_order_release);
+    }
+};
+thread_local ThreadSlot self;
+}
+
+/** ===========================================================================
+    EpochDomain Functions
+---------------------------------------------------------------------------- */
+EpochDomain& EpochDomain::global() {
+    static EpochDomain domain;
+    return domain;
+}
+
+EpochDomain::Slot& EpochDomain::mySlot() {
+    if (self.slot == nullptr) {
+        for (int i = 0; ; i = (i + 1) % MAX_THREADS) {
+            bool expected = false;
+            if (slots[i].claimed.compare_exchange_strong(expected, true)) {
+                self.claimed = &slots[i].claimed;
+                self.slot = &slots[i];
+                break;
+            }
+            if (i == MAX_THREADS - 1) {
+                std::this_thread::yield(); // all taken, wait for an exit
+            }
+        }
+    }
+    return *static_cast<Slot*>(self.slot);
+}
+
+void EpochDomain::enter() {
+    if (self.depth++ > 0) return;
+
+    Slot& s = mySlot();
+    s.epoch.store(current.load(std::memory_order_acquire),
+                  std::memory_order_relaxed);
+    // the pin must be visible before any shared pointer is read.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void EpochDomain::exit() {
+    if (--self.depth > 0) return;
+
+    mySlot().epoch.store(0, std::memory_order_release);
+}
+
+uint64_t EpochDomain::retire() {
+    return current.fetch_add(1, std::memory_order_seq_cst);
+}
+
+uint64_t EpochDomain::horizon() const {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = UINT64_MAX;
+    for (const Slot& s : slots) {
+        uint64_t e = s.epoch.load(std::memory_order_acquire);
+        if (e != 0 && e < oldest) {
+            oldest = e;
+        }
+    }
+    return oldest;
+}
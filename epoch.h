@@ -0,0 +1,89 @@
+/** ===========================================================================
+    epoch.h
+    Purpose: epoch-based reclamation for lock-free readers.
+
+    Readers pin the current epoch for the duration of a lookup. A writer
+    that unlinks memory tags it with the epoch at the time of unlinking and
+    frees it only once no reader is still pinned at or before that epoch,
+    i.e. once every reader that could have seen the old pointer has left.
+
+    Assumptions:
+    There is a single process-wide domain shared by every tree. Each thread
+    claims one of MAX_THREADS reader slots on first use and gives it back
+    when the thread exits; further threads wait for a slot to free up.
+
+    @author: Charlie Nguyen
+    @version: 1.0
+---------------------------------------------------------------------------- */
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <cstdint>
+
+class EpochDomain
+{
+public:
+    static const int MAX_THREADS = 128;
+
+    /** =======================================================================
+        @return the process-wide domain.
+        -------------------------------------------------------------------- */
+    static EpochDomain& global();
+
+    /** =======================================================================
+        Pins the calling thread to the current epoch. Calls nest; only the
+        outermost enter/exit pair has an effect.
+        -------------------------------------------------------------------- */
+    void enter();
+
+    /** =======================================================================
+        Unpins the calling thread.
+        -------------------------------------------------------------------- */
+    void exit();
+
+    /** =======================================================================
+        Called by a writer after unlinking memory. Advances the epoch.
+
+        @return the tag to store with the unlinked memory.
+        -------------------------------------------------------------------- */
+    uint64_t retire();
+
+    /** =======================================================================
+        Finds the oldest epoch any reader is pinned at. Memory retired with a
+        tag below it can no longer be reached by any reader and may be freed.
+
+        @return the oldest pinned epoch, or UINT64_MAX if none is pinned.
+        -------------------------------------------------------------------- */
+    uint64_t horizon() const;
+
+private:
+    // one cache line per reader so pinning never contends.
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{0};   // pinned epoch, 0 when idle
+        std::atomic<bool> claimed{false}; // owned by a live thread
+    };
+
+    Slot slots[MAX_THREADS];
+    alignas(64) std::atomic<uint64_t> current{1};
+
+    EpochDomain() {}
+
+    /** =======================================================================
+        @return the calling thread's slot, claiming one on first use.
+        -------------------------------------------------------------------- */
+    Slot& mySlot();
+};
+
+/** ===========================================================================
+    Pins the calling thread for the lifetime of the guard.
+---------------------------------------------------------------------------- */
+class EpochGuard
+{
+public:
+    EpochGuard() { EpochDomain::global().enter(); }
+    ~EpochGuard() { EpochDomain::global().exit(); }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+#endif
@@ -0,0 +1,62 @@
+#include "frozentree.h"
+#include <cstdint>
+
+// how far ahead of the current index to prefetch: 16 slots is four levels
+// down, and the 16 pointers there span two cache lines.
+static const int PREFETCH_AHEAD = 16;
+
+/** ===========================================================================
+    Constructors
+---------------------------------------------------------------------------- */
+FrozenTree::FrozenTree(const vector<NodeData*>& sorted)
+    : eyt(sorted.size() + 1, nullptr), n(static_cast<int>(sorted.size())) {
+    build(sorted, 0, 1);
+}
+
+int FrozenTree::build(const vector<NodeData*>& sorted, int i, int k) {
+    if (k > n) return i;
+
+    i = build(sorted, i, 2 * k);
+    eyt[k] = sorted[i++];
+    return build(sorted, i, 2 * k + 1);
+}
+
+/** ===========================================================================
+    FrozenTree Functions
+---------------------------------------------------------------------------- */
+bool FrozenTree::isEmpty() const {
+    return n == 0;
+}
+
+int FrozenTree::size() const {
+    return n;
+}
+
+bool FrozenTree::retrieve(const NodeData& target, NodeData*& ret) const {
+    // descend to a leaf, going right whenever the slot is smaller. the path
+    // taken is recorded in the bits of k.
+    uintptr_t base = reinterpret_cast<uintptr_t>(eyt.data());
+    unsigned k = 1;
+    while (k <= static_cast<unsigned>(n)) {
+#if defined(__GNUC__)
+        // address arithmetic only; prefetching past the end cannot fault.
+        __builtin_prefetch(reinterpret_cast<const void*>(
+            base + k * PREFETCH_AHEAD * sizeof(NodeData*)));
+#endif
+        k = 2 * k + static_cast<unsigned>(*eyt[k] < target);
+    }
+
+    // the lower bound is where the path last turned left: strip the
+    // trailing right turns (1 bits), then that left turn itself.
+#if defined(__GNUC__)
+    k >>= __builtin_ffs(~k);
+#else
+    while (k & 1) {
+        k >>= 1;
+    }
+    k >>= 1;
+#endif
+
+    ret = (k != 0 && *eyt[k] == target) ? eyt[k] : nullptr;
+    return ret != nullptr;
+}
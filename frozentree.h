@@ -0,0 +1,71 @@
+/** ===========================================================================
+    frozentree.h
+    Purpose: a read-only snapshot of a BinTree laid out for fast lookups.
+
+    The NodeData*s are stored in one contiguous array in Eytzinger (BFS)
+    order: the root at index 1 and the children of index k at 2k and 2k+1.
+    A search touches the array top to bottom, so the next few levels can be
+    prefetched while the current one is compared, and the descent itself
+    picks the next index with arithmetic instead of a branch.
+
+    Assumptions:
+    The snapshot does not own its NodeData. It is only valid while the tree
+    it was frozen from is neither modified nor destroyed.
+
+    @author: Charlie Nguyen
+    @version: 1.0
+---------------------------------------------------------------------------- */
+#ifndef FROZENTREE_H
+#define FROZENTREE_H
+
+#include "nodedata.h"
+#include <vector>
+
+class FrozenTree
+{
+public:
+    /** =======================================================================
+        Constructor. Lays out an already sorted (assumed) sequence.
+
+        @param sorted The NodeData*s in ascending order.
+        -------------------------------------------------------------------- */
+    explicit FrozenTree(const vector<NodeData*>& sorted = vector<NodeData*>());
+
+    /** =======================================================================
+        Checks to see if the snapshot is empty.
+
+        @return true if empty, false otherwise.
+        -------------------------------------------------------------------- */
+    bool isEmpty() const;
+
+    /** =======================================================================
+        @return the number of NodeData in the snapshot.
+        -------------------------------------------------------------------- */
+    int size() const;
+
+    /** =======================================================================
+        Finds the NodeData* matching the target. Returns the same pointer that
+        BinTree::retrieve would on the tree the snapshot was taken from.
+
+        @param target The NodeData object to search for.
+        @param ret The matching NodeData if found, nullptr otherwise.
+        @return true if found, false otherwise.
+        -------------------------------------------------------------------- */
+    bool retrieve(const NodeData& target, NodeData*& ret) const;
+
+private:
+    vector<NodeData*> eyt; // Eytzinger order, index 0 unused
+    int n = 0;             // number of NodeData, the last valid index
+
+    /** =======================================================================
+        Helper method that fills eyt by an in-order walk of the implicit tree,
+        consuming sorted elements in ascending order.
+
+        @param sorted The NodeData*s in ascending order.
+        @param i The next element of sorted to place.
+        @param k The current index in eyt.
+        @return the next element of sorted after this subtree.
+        -------------------------------------------------------------------- */
+    int build(const vector<NodeData*>& sorted, int i, int k);
+};
+#endif
@@ -0,0 +1,107 @@
+#include "hashindex.h"
+#include <functional>
+
+/** ===========================================================================
+    Constructors/ Destructors
+---------------------------------------------------------------------------- */
+HashIndex::HashIndex() {}
+
+/** ===========================================================================
+    HashIndex Functions
+---------------------------------------------------------------------------- */
+int HashIndex::size() const {
+    return count;
+}
+
+void HashIndex::clear() {
+    vector<Slot>().swap(slots);
+    mask = 0;
+    count = 0;
+}
+
+void HashIndex::reserve(int n) {
+    size_t capacity = 16;
+    while (capacity < 2 * static_cast<size_t>(n)) {
+        capacity *= 2;
+    }
+    if (capacity > slots.size()) {
+        rehash(capacity);
+    }
+}
+
+bool HashIndex::insert(NodeData* nd) {
+    if (2 * static_cast<size_t>(count + 1) > slots.size()) {
+        rehash(slots.empty() ? 16 : 2 * slots.size());
+    }
+    uint64_t hash = hashOf(nd->getData());
+    size_t i = probe(nd->getData(), hash);
+    if (slots[i].nd != nullptr) {
+        return false;
+    }
+    slots[i].hash = hash;
+    slots[i].nd = nd;
+    count++;
+    return true;
+}
+
+bool HashIndex::erase(string_view key) {
+    if (count == 0) return false;
+
+    size_t i = probe(key, hashOf(key));
+    if (slots[i].nd == nullptr) {
+        return false;
+    }
+
+    // pull back later entries of the run that may no longer reach their
+    // slot past the hole.
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (slots[j].nd == nullptr) break;
+
+        size_t home = slots[j].hash & mask;
+        bool reachable = (i <= j) ? (i < home && home <= j)
+                                  : (i < home || home <= j);
+        if (!reachable) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i] = Slot();
+    count--;
+    return true;
+}
+
+NodeData* HashIndex::find(string_view key) const {
+    if (count == 0) return nullptr;
+
+    return slots[probe(key, hashOf(key))].nd;
+}
+
+uint64_t HashIndex::hashOf(string_view key) {
+    return hash<string_view>()(key);
+}
+
+size_t HashIndex::probe(string_view key, uint64_t hash) const {
+    size_t i = hash & mask;
+    while (slots[i].nd != nullptr &&
+           (slots[i].hash != hash || slots[i].nd->compare(key) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void HashIndex::rehash(size_t capacity) {
+    vector<Slot> old(capacity);
+    old.swap(slots);
+    mask = capacity - 1;
+    for (const Slot& s : old) {
+        if (s.nd == nullptr) continue;
+
+        size_t i = s.hash & mask;
+        while (slots[i].nd != nullptr) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = s;
+    }
+}
@@ -0,0 +1,112 @@
+/** ===========================================================================
+    hashindex.h
+    Purpose: an open-addressing hash table from a NodeData's key to the
+    NodeData, used by BinTree to answer exact-match lookups without
+    descending the tree.
+
+    Slots sit in one array and are probed linearly from the key's hash, so
+    a lookup usually reads one or two adjacent slots. Each slot keeps the
+    key's full hash next to the pointer, so NodeData strings are only
+    compared when the hashes agree. Erasing shifts the rest of the probe
+    run back rather than leaving a tombstone, so lookups never slow down
+    with churn.
+
+    Assumptions:
+    The index does not own the NodeData. Whoever fills it must erase a
+    NodeData (or clear the index) before deleting it or changing its key.
+    The table is at most half full; it doubles in size to stay that way.
+
+    @author: Charlie Nguyen
+    @version: 1.0
+---------------------------------------------------------------------------- */
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include "nodedata.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+class HashIndex
+{
+public:
+    /** =======================================================================
+        Default constructor. Allocates nothing until the first insert.
+        -------------------------------------------------------------------- */
+    HashIndex();
+
+    /** =======================================================================
+        @return the number of NodeData in the index.
+        -------------------------------------------------------------------- */
+    int size() const;
+
+    /** =======================================================================
+        Removes every entry and frees the table.
+        -------------------------------------------------------------------- */
+    void clear();
+
+    /** =======================================================================
+        Sizes the table for n entries, so filling it does not rehash.
+
+        @param n The number of entries expected.
+        -------------------------------------------------------------------- */
+    void reserve(int n);
+
+    /** =======================================================================
+        Adds a NodeData under its key, ignoring duplicates.
+
+        @param nd The NodeData. Must not be nullptr.
+        @return true if added, false if its key was already present.
+        -------------------------------------------------------------------- */
+    bool insert(NodeData* nd);
+
+    /** =======================================================================
+        Removes the entry for a key.
+
+        @param key The key to remove.
+        @return true if removed, false if it was not present.
+        -------------------------------------------------------------------- */
+    bool erase(string_view key);
+
+    /** =======================================================================
+        Finds the NodeData with a key.
+
+        @param key The key to search for.
+        @return the NodeData, nullptr if not present.
+        -------------------------------------------------------------------- */
+    NodeData* find(string_view key) const;
+
+private:
+    struct Slot {
+        uint64_t hash = 0;        // hash of nd's key
+        NodeData* nd = nullptr;   // nullptr if the slot is free
+    };
+
+    vector<Slot> slots; // power of two in size, or empty
+    size_t mask = 0;    // slots.size() - 1
+    int count = 0;      // slots in use
+
+    /** =======================================================================
+        @param key The key.
+        @return the key's hash.
+        -------------------------------------------------------------------- */
+    static uint64_t hashOf(string_view key);
+
+    /** =======================================================================
+        Finds the slot holding a key, or the free slot ending its probe run.
+
+        @param key The key.
+        @param hash hashOf(key).
+        @return index of the slot. slots must not be empty.
+        -------------------------------------------------------------------- */
+    size_t probe(string_view key, uint64_t hash) const;
+
+    /** =======================================================================
+        Moves every entry into a table of the given size.
+
+        @param capacity The new number of slots, a power of two.
+        -------------------------------------------------------------------- */
+    void rehash(size_t capacity);
+};
+#endif
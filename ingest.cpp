@@ -0,0 +1,49 @@
+#include "ingest.h"
+
+/** ===========================================================================
+    Tokenizer Functions
+---------------------------------------------------------------------------- */
+Tokenizer::Tokenizer(const char* begin, size_t length)
+    : pos(begin), end(begin + length) {}
+
+// the same characters operator>> treats as separators.
+static bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f' ||
+           c == '\v';
+}
+
+void Tokenizer::skipSpace() {
+    while (pos < end && isSpace(*pos)) {
+        pos++;
+    }
+}
+
+bool Tokenizer::atEnd() {
+    skipSpace();
+    return pos == end;
+}
+
+bool Tokenizer::next(string_view& tok) {
+    skipSpace();
+    if (pos == end) {
+        return false;
+    }
+    const char* start = pos;
+    while (pos < end && !isSpace(*pos)) {
+        pos++;
+    }
+    tok = string_view(start, pos - start);
+    return true;
+}
+
+/** ===========================================================================
+    Ingest
+---------------------------------------------------------------------------- */
+int ingestTree(BinTree& T, Tokenizer& in) {
+    int inserted = 0;
+    string_view tok;
+    while (in.next(tok) && tok != "$$") {
+        inserted += T.emplace(tok);
+    }
+    return inserted;
+}
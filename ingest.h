@@ -0,0 +1,63 @@
+/** ===========================================================================
+    ingest.h
+    Purpose: build BinTrees straight from an in-memory (e.g. memory-mapped)
+    copy of a data file such as data2.txt.
+
+    Tokens are whitespace separated, and "$$" ends the current tree. Each
+    token is a view into the buffer, so nothing is copied or allocated
+    until a token turns out to be new to the tree.
+
+    @author: Charlie Nguyen
+    @version: 1.0
+---------------------------------------------------------------------------- */
+#ifndef INGEST_H
+#define INGEST_H
+
+#include "bintree.h"
+#include <cstddef>
+#include <string_view>
+
+class Tokenizer
+{
+public:
+    /** =======================================================================
+        Constructor.
+
+        @param begin The first byte of the text. Must outlive the Tokenizer.
+        @param length The number of bytes of text.
+        -------------------------------------------------------------------- */
+    Tokenizer(const char* begin, size_t length);
+
+    /** =======================================================================
+        Reads the next whitespace-separated token.
+
+        @param tok Set to a view of the token within the text.
+        @return true if a token was read, false at the end of the text.
+        -------------------------------------------------------------------- */
+    bool next(string_view& tok);
+
+    /** =======================================================================
+        @return true if only whitespace (or nothing) is left to read.
+        -------------------------------------------------------------------- */
+    bool atEnd();
+
+private:
+    const char* pos; // next byte to read
+    const char* end; // one past the last byte
+
+    /** =======================================================================
+        Advances pos past any whitespace.
+        -------------------------------------------------------------------- */
+    void skipSpace();
+};
+
+/** ===========================================================================
+    Inserts tokens into a tree until "$$" or the end of the text. A token
+    already in the tree is skipped without allocating a NodeData.
+
+    @param T The tree to insert into.
+    @param in The source of tokens.
+    @return the number of NodeData inserted.
+---------------------------------------------------------------------------- */
+int ingestTree(BinTree& T, Tokenizer& in);
+#endif
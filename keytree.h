@@ -0,0 +1,308 @@
+/** ===========================================================================
+    keytree.h
+    Purpose: implement a Binary Search Tree over keys stored by value.
+
+    KeyTree<Key, Compare, Alloc> is the templated counterpart of BinTree.
+    Each Node holds its key inline rather than pointing at a heap NodeData,
+    and Compare is a header-only three-way comparison, so a KeyTree over an
+    integral type (e.g. KeyTree<int64_t>) has no out-of-line calls or string
+    comparisons on its search path. KeyTree<> is instantiated over NodeData.
+
+    Assumptions:
+    Duplicate keys are ignored when inserting into a tree.
+    The tree is always AVL balanced, so its height stays O(log n) regardless
+    of the order keys arrive in.
+    Key must be copyable and ordered by operator<. Alloc<T> must provide
+    allocate(), release(T*) and clear() like NodePool.
+
+    @author: Charlie Nguyen
+    @version: 1.0
+---------------------------------------------------------------------------- */
+#ifndef KEYTREE_H
+#define KEYTREE_H
+
+#include "nodedata.h"
+#include "nodepool.h"
+#include <iostream>
+#include <type_traits>
+
+/** ===========================================================================
+    Default three-way comparison: negative, zero or positive as a is less
+    than, equal to or greater than b. For integral keys both relational
+    operators compile to flag-setting instructions, with no branch.
+---------------------------------------------------------------------------- */
+template <class Key>
+struct KeyCompare {
+    static int compare(const Key& a, const Key& b) {
+        return static_cast<int>(b < a) - static_cast<int>(a < b);
+    }
+};
+
+// NodeData compares in one pass rather than two.
+template <>
+struct KeyCompare<NodeData> {
+    static int compare(const NodeData& a, const NodeData& b) {
+        return a.compare(b);
+    }
+};
+
+template <class Key = NodeData, class Compare = KeyCompare<Key>,
+          template <class> class Alloc = NodePool>
+class KeyTree
+{
+    // operator<< method can access KeyTree class' private properties
+    friend std::ostream& operator<<(std::ostream& out, const KeyTree& kt) {
+        if (kt.isEmpty()) {
+            out << "! -- tree is empty -- !" << std::endl;
+        } else {
+            kt.inorder(out);
+            out << std::endl;
+        }
+        return out;
+    }
+private:
+    // Tree is composed of Nodes holding their key inline.
+    struct Node {
+        Key key = Key();             // the key itself
+        Node* child[2] = {nullptr, nullptr}; // [0] left, [1] right subtree
+        int height = 1;              // height of this subtree, leaf is 1
+    };
+public:
+    /** =======================================================================
+        Default constructor.
+        -------------------------------------------------------------------- */
+    KeyTree() {}
+
+    /** =======================================================================
+        Copy constructor.
+
+        @param rhs The tree to be copied.
+        -------------------------------------------------------------------- */
+    KeyTree(const KeyTree& rhs) { *this = rhs; }
+
+    /** =======================================================================
+        Destructor.
+        -------------------------------------------------------------------- */
+    ~KeyTree() { makeEmpty(); }
+
+    /** =======================================================================
+        Assignment operator. Overwrites own keys to match the right-hand side,
+        reusing existing Nodes where the shapes overlap.
+
+        @param rhs KeyTree to be copied.
+        -------------------------------------------------------------------- */
+    KeyTree& operator=(const KeyTree& rhs) {
+        if (this != &rhs) {
+            copySubtree(root, rhs.root);
+            count = rhs.count;
+        }
+        return *this;
+    }
+
+    /** =======================================================================
+        Checks if a KeyTree has the same shape and keys as its right-hand
+        counterpart.
+
+        @param rhs KeyTree to compare against for equality.
+        @return true if equal, false otherwise.
+        -------------------------------------------------------------------- */
+    bool operator==(const KeyTree& rhs) const {
+        return count == rhs.count && checkEqual(root, rhs.root);
+    }
+
+    bool operator!=(const KeyTree& rhs) const { return !(*this == rhs); }
+
+    /** =======================================================================
+        @return true if empty, false otherwise.
+        -------------------------------------------------------------------- */
+    bool isEmpty() const { return root == nullptr; }
+
+    /** =======================================================================
+        @return the number of keys in the tree.
+        -------------------------------------------------------------------- */
+    int size() const { return count; }
+
+    /** =======================================================================
+        Removes every key, returning the Nodes to the allocator wholesale.
+        -------------------------------------------------------------------- */
+    void makeEmpty() {
+        if (!std::is_trivially_destructible<Key>::value) {
+            pluck(root);
+        }
+        root = nullptr;
+        count = 0;
+        pool.clear();
+    }
+
+    /** =======================================================================
+        Inserts a copy of key, ignoring duplicates and rebalancing on the way
+        back up.
+
+        @param key The key to be inserted.
+        @return true if inserted, false if it was already present.
+        -------------------------------------------------------------------- */
+    bool insert(const Key& key) {
+        if (!insert(key, root)) {
+            return false;
+        }
+        ++count;
+        return true;
+    }
+
+    /** =======================================================================
+        Finds the key in the tree matching the target.
+
+        @param target The key to search for.
+        @param ret The matching key in the tree if found, nullptr otherwise.
+        @return true if found, false otherwise.
+        -------------------------------------------------------------------- */
+    bool retrieve(const Key& target, const Key*& ret) const {
+        const Node* n = root;
+        while (n != nullptr) {
+            int c = Compare::compare(target, n->key);
+            if (c == 0) {
+                ret = &n->key;
+                return true;
+            }
+            n = n->child[c > 0];
+        }
+        ret = nullptr;
+        return false;
+    }
+
+    /** =======================================================================
+        @param target The key to search for.
+        @return true if the tree contains target, false otherwise.
+        -------------------------------------------------------------------- */
+    bool contains(const Key& target) const {
+        const Key* ret;
+        return retrieve(target, ret);
+    }
+
+    /** =======================================================================
+        Finds the depth of the Node containing target by following its search
+        path.
+
+        @param target Key to find depth of.
+        @return depth of the key. 0 is not found, 1 is root.
+        -------------------------------------------------------------------- */
+    int getDepth(const Key& target) const {
+        int depth = 1;
+        for (const Node* n = root; n != nullptr; ++depth) {
+            int c = Compare::compare(target, n->key);
+            if (c == 0) {
+                return depth;
+            }
+            n = n->child[c > 0];
+        }
+        return 0;
+    }
+
+    /** =======================================================================
+        Prints the keys in LNR order, separated by spaces.
+
+        @param out The stream to be printed on.
+        -------------------------------------------------------------------- */
+    void inorder(std::ostream& out) const { inorderHelper(root, out); }
+
+private:
+    Node* root = nullptr; // Root Node for entire KeyTree
+    int count = 0;        // number of keys in the tree
+    Alloc<Node> pool;     // storage for every Node in this tree
+
+    static int height(const Node* n) { return n == nullptr ? 0 : n->height; }
+
+    static void update(Node* n) {
+        int hl = height(n->child[0]);
+        int hr = height(n->child[1]);
+        n->height = 1 + (hl > hr ? hl : hr);
+    }
+
+    /** =======================================================================
+        Rotates the child on side d up into n's place: d == 1 is a left
+        rotation, d == 0 a right rotation.
+
+        @param n The root of the subtree, updated to point at the new root.
+        @param d Which child to promote.
+        -------------------------------------------------------------------- */
+    static void rotate(Node*& n, int d) {
+        Node* c = n->child[d];
+        n->child[d] = c->child[!d];
+        c->child[!d] = n;
+        update(n);
+        update(c);
+        n = c;
+    }
+
+    /** =======================================================================
+        Restores the AVL property at n with a single or double rotation.
+
+        @param n The root of the subtree, updated to point at the new root.
+        -------------------------------------------------------------------- */
+    static void rebalance(Node*& n) {
+        int skew = height(n->child[1]) - height(n->child[0]);
+        if (skew > 1 || skew < -1) {
+            int d = skew > 0;
+            Node*& c = n->child[d];
+            if (height(c->child[!d]) > height(c->child[d])) {
+                rotate(c, !d);
+            }
+            rotate(n, d);
+        }
+    }
+
+    bool insert(const Key& key, Node*& n) {
+        if (n == nullptr) {
+            n = pool.allocate();
+            n->key = key;
+            return true;
+        }
+        int c = Compare::compare(key, n->key);
+        if (c == 0 || !insert(key, n->child[c > 0])) {
+            return false;
+        }
+        update(n);
+        rebalance(n);
+        return true;
+    }
+
+    void pluck(Node*& n) {
+        if (n == nullptr) return;
+
+        pluck(n->child[0]);
+        pluck(n->child[1]);
+        pool.release(n);
+        n = nullptr;
+    }
+
+    void copySubtree(Node*& lhs, const Node* rhs) {
+        if (rhs == nullptr) {
+            pluck(lhs);
+            return;
+        }
+        if (lhs == nullptr) {
+            lhs = pool.allocate();
+        }
+        lhs->key = rhs->key;
+        lhs->height = rhs->height;
+        copySubtree(lhs->child[0], rhs->child[0]);
+        copySubtree(lhs->child[1], rhs->child[1]);
+    }
+
+    bool checkEqual(const Node* n, const Node* rhs) const {
+        if (n == nullptr || rhs == nullptr) return n == rhs;
+
+        return Compare::compare(n->key, rhs->key) == 0 &&
+               checkEqual(n->child[0], rhs->child[0]) &&
+               checkEqual(n->child[1], rhs->child[1]);
+    }
+
+    void inorderHelper(const Node* n, std::ostream& out) const {
+        if (n == nullptr) return;
+
+        inorderHelper(n->child[0], out);
+        out << n->key << " ";
+        inorderHelper(n->child[1], out);
+    }
+};
+#endif
@@ -0,0 +1,56 @@
+#include "mappedfile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** ===========================================================================
+    Constructors/ Destructors
+---------------------------------------------------------------------------- */
+MappedFile::MappedFile() {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+/** ===========================================================================
+    MappedFile Functions
+---------------------------------------------------------------------------- */
+bool MappedFile::open(const string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok && st.st_size > 0) {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = (p != MAP_FAILED);
+        if (ok) {
+            // tokens are read front to back; let the OS read ahead.
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            base = static_cast<const char*>(p);
+            length = static_cast<size_t>(st.st_size);
+        }
+    }
+    ::close(fd); // the mapping stays valid without the descriptor
+    return ok;
+}
+
+void MappedFile::close() {
+    if (base != nullptr) {
+        munmap(const_cast<char*>(base), length);
+    }
+    base = nullptr;
+    length = 0;
+}
+
+const char* MappedFile::data() const {
+    return base;
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
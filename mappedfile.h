@@ -0,0 +1,65 @@
+/** ===========================================================================
+    mappedfile.h
+    Purpose: read-only memory mapping of a whole file.
+
+    The file's bytes are addressed directly in memory, with no copy into a
+    user buffer, and pages are read in by the OS on first touch.
+
+    Assumptions:
+    POSIX (mmap). An empty file maps successfully with size 0.
+
+    @author: Charlie Nguyen
+    @version: 1.0
+---------------------------------------------------------------------------- */
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+using namespace std;
+
+class MappedFile
+{
+public:
+    /** =======================================================================
+        Default constructor. Nothing is mapped until open is called.
+        -------------------------------------------------------------------- */
+    MappedFile();
+
+    /** =======================================================================
+        Destructor. Unmaps the file, if any.
+        -------------------------------------------------------------------- */
+    ~MappedFile();
+
+    // Copying is not supported.
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /** =======================================================================
+        Maps a file for reading, unmapping whatever was mapped before.
+
+        @param path The file to map.
+        @return true if mapped, false if the file could not be opened.
+        -------------------------------------------------------------------- */
+    bool open(const string& path);
+
+    /** =======================================================================
+        Unmaps the file. data() is nullptr afterwards.
+        -------------------------------------------------------------------- */
+    void close();
+
+    /** =======================================================================
+        @return the first byte of the file, nullptr if nothing is mapped.
+        -------------------------------------------------------------------- */
+    const char* data() const;
+
+    /** =======================================================================
+        @return the length of the file in bytes.
+        -------------------------------------------------------------------- */
+    size_t size() const;
+
+private:
+    const char* base = nullptr; // start of the mapping
+    size_t length = 0;          // bytes mapped
+};
+#endif
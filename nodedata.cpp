@@ -9,6 +9,7 @@
     @author: Dr. Carol Zander (with modifications by Charlie Nguyen)
 ---------------------------------------------------------------------------- */
 #include "nodedata.h"
+#include <functional>
 
 //----------------------------------------------------------------------------
 // constructors/destructor  
@@ -61,6 +62,48 @@ bool NodeData::operator>=(const NodeData& rhs) const {
 	return data >= rhs.data;
 }
 
+//----------------------------------------------------------------------------
+// hash 
+
+size_t NodeData::hash() const {
+	return std::hash<string>()(data);
+}
+
+//----------------------------------------------------------------------------
+// getData 
+
+const string& NodeData::getData() const {
+	return data;
+}
+
+//----------------------------------------------------------------------------
+// compare 
+
+int NodeData::compare(string_view key) const {
+	return string_view(data).compare(key);
+}
+
+int NodeData::compare(const NodeData& rhs) const {
+	return data.compare(rhs.data);
+}
+
+//----------------------------------------------------------------------------
+// prefix 
+
+uint64_t NodeData::prefix() const {
+	return prefixOf(data);
+}
+
+uint64_t NodeData::prefixOf(string_view key) {
+	char bytes[8] = {};
+	key.copy(bytes, 8);
+	uint64_t v = 0;
+	for (char b : bytes) {              // compiles to one load and bswap
+		v = (v << 8) | static_cast<unsigned char>(b);
+	}
+	return v;
+}
+
 //----------------------------------------------------------------------------
 // setData 
 // returns true if the data is set, false when bad data, i.e., is eof
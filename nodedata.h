@@ -10,7 +10,9 @@
 ---------------------------------------------------------------------------- */
 #ifndef NODEDATA_H
 #define NODEDATA_H
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <fstream>
 using namespace std;
@@ -38,6 +40,24 @@ public:
 	bool operator<=(const NodeData&) const;
 	bool operator>=(const NodeData&) const;
 
+	// hash of the data, equal for equal NodeData
+	size_t hash() const;
+
+	// the data itself
+	const string& getData() const;
+
+	// compares the data with a raw key: negative, zero or positive as the
+	// data is less than, equal to or greater than key
+	int compare(string_view key) const;
+
+	// the same, against another NodeData's data
+	int compare(const NodeData&) const;
+
+	// the first 8 bytes of the data packed big-endian (zero padded), so
+	// that unequal prefixes order the same way the whole data does
+	uint64_t prefix() const;
+	static uint64_t prefixOf(string_view key);
+
 private:
 	string data;
 };
@@ -0,0 +1,177 @@
+/** ===========================================================================
+    nodepool.h
+    Purpose: a slab allocator for fixed-size tree nodes.
+
+    Nodes are carved out of contiguous chunks instead of being allocated one
+    at a time from the heap. Released nodes go onto a free list and are
+    handed out again before a new chunk is touched, and the whole pool can be
+    dropped at once in O(chunks).
+
+    Assumptions:
+    T must be default constructible. clear() frees chunks without visiting
+    the objects inside them, so objects that are not trivially destructible
+    must all be released before the pool is cleared or destroyed.
+    A pool is not thread-safe. Pools may share chunks (see share), in which
+    case a chunk's memory lasts until every pool holding it lets go.
+
+    @author: Charlie Nguyen
+    @version: 1.0
+---------------------------------------------------------------------------- */
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <memory>
+#include <new>
+#include <unordered_set>
+#include <vector>
+
+template <class T>
+class NodePool
+{
+public:
+    /** =======================================================================
+        Constructor.
+
+        @param firstChunk Number of slots in the first chunk. Each following
+                          chunk doubles in size, up to MAX_CHUNK slots.
+        -------------------------------------------------------------------- */
+    explicit NodePool(int firstChunk = 16) : nextSize(firstChunk) {}
+
+    /** =======================================================================
+        Destructor. Returns every chunk to the heap.
+        -------------------------------------------------------------------- */
+    ~NodePool() { clear(); }
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    /** =======================================================================
+        Hands out a default-constructed T, recycling a released slot if one
+        is available.
+
+        @return pointer to the new object.
+        -------------------------------------------------------------------- */
+    T* allocate() {
+        Slot* s = freeList;
+        if (s != nullptr) {
+            freeList = s->next;
+        } else {
+            if (used == chunkSize) {
+                grow();
+            }
+            s = &chunks.back()[used++];
+        }
+        ++live;
+        return new (s->obj) T();
+    }
+
+    /** =======================================================================
+        Hands out count default-constructed Ts side by side in a chunk of
+        their own, so they can be indexed like an array and filled in by
+        several threads without touching the pool. Each may later be passed
+        to release() individually.
+
+        @param count The number of objects.
+        @return pointer to the first object.
+        -------------------------------------------------------------------- */
+    T* allocateBlock(int count) {
+        static_assert(sizeof(Slot) == sizeof(T),
+                      "block elements must be laid out like a T array");
+        std::shared_ptr<Slot[]> block(new Slot[count]);
+        if (chunks.empty()) {
+            chunks.push_back(block);
+            used = chunkSize = count;
+        } else {
+            // keep the partly used chunk last, where allocate() expects it.
+            chunks.insert(chunks.end() - 1, block);
+        }
+        live += count;
+        for (int i = 0; i < count; i++) {
+            new (block[i].obj) T();
+        }
+        return reinterpret_cast<T*>(block.get());
+    }
+
+    /** =======================================================================
+        Destroys an object and returns its slot to the free list. The memory
+        stays in the pool.
+
+        @param p An object previously returned by allocate().
+        -------------------------------------------------------------------- */
+    void release(T* p) {
+        if (p == nullptr) return;
+        p->~T();
+        Slot* s = reinterpret_cast<Slot*>(p);
+        s->next = freeList;
+        freeList = s;
+        --live;
+    }
+
+    /** =======================================================================
+        Gives this pool a share in every chunk of other, so that objects
+        allocated by other stay valid for as long as either pool holds the
+        chunk, and may be released to this pool. Used when a container takes
+        over objects from another one.
+
+        @param other The pool whose chunks to share.
+        -------------------------------------------------------------------- */
+    void share(const NodePool& other) {
+        std::unordered_set<const Slot*> mine;
+        for (const std::shared_ptr<Slot[]>& c : chunks) {
+            mine.insert(c.get());
+        }
+        // in front, so the partly used chunk stays last.
+        std::vector<std::shared_ptr<Slot[]>> theirs;
+        for (const std::shared_ptr<Slot[]>& c : other.chunks) {
+            if (mine.count(c.get()) == 0) {
+                theirs.push_back(c);
+            }
+        }
+        chunks.insert(chunks.begin(), theirs.begin(), theirs.end());
+    }
+
+    /** =======================================================================
+        Frees every chunk at once, invalidating all objects handed out. A
+        chunk shared with another pool is only let go of.
+        -------------------------------------------------------------------- */
+    void clear() {
+        chunks.clear();
+        freeList = nullptr;
+        used = chunkSize = live = 0;
+    }
+
+    /** =======================================================================
+        @return number of objects handed out and not yet released, counting
+                releases of objects from shared chunks against this pool.
+        -------------------------------------------------------------------- */
+    int size() const { return live; }
+
+private:
+    static const int MAX_CHUNK = 4096;
+
+    // a slot holds either a live object or a link in the free list.
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char obj[sizeof(T)];
+    };
+
+    std::vector<std::shared_ptr<Slot[]>> chunks; // the last one being filled
+    Slot* freeList = nullptr;    // released slots, most recent first
+    int used = 0;                // slots handed out of the last chunk
+    int chunkSize = 0;           // capacity of the last chunk
+    int nextSize;                // capacity of the next chunk to allocate
+    int live = 0;                // objects currently handed out
+
+    /** =======================================================================
+        Starts a new chunk, doubling the chunk size for next time.
+        -------------------------------------------------------------------- */
+    void grow() {
+        chunkSize = nextSize;
+        chunks.push_back(std::shared_ptr<Slot[]>(new Slot[chunkSize]));
+        used = 0;
+        if (nextSize < MAX_CHUNK) {
+            nextSize *= 2;
+        }
+    }
+};
+#endif
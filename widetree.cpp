@@ -0,0 +1,186 @@
+#include "widetree.h"
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+/** ===========================================================================
+    Constructors/ Destructors
+---------------------------------------------------------------------------- */
+WideTree::Node::Node() {
+    for (int i = 0; i < WIDTH; i++) {
+        keys[i] = INT64_MAX;
+        child[i] = nullptr;
+    }
+}
+
+WideTree::WideTree() {}
+
+WideTree::~WideTree() {
+    makeEmpty();
+}
+
+/** ===========================================================================
+    Operator Overrides
+---------------------------------------------------------------------------- */
+ostream& operator<<(ostream& out, const WideTree& wt) {
+    if (wt.isEmpty()) {
+        out << "! -- tree is empty -- !" << endl;
+    } else {
+        wt.inorder(out);
+        out << endl;
+    }
+    return out;
+}
+
+void WideTree::inorder(ostream& out) const {
+    inorderHelper(root, out);
+}
+
+void WideTree::inorderHelper(const Node* n, ostream& out) const {
+    if (n == nullptr) return;
+
+    for (int i = 0; i < n->count; i++) {
+        if (!n->leaf) inorderHelper(n->child[i], out);
+        out << n->keys[i] << " ";
+    }
+    if (!n->leaf) inorderHelper(n->child[n->count], out);
+}
+
+/** ===========================================================================
+    WideTree Functions
+---------------------------------------------------------------------------- */
+bool WideTree::isEmpty() const {
+    return root == nullptr;
+}
+
+int WideTree::size() const {
+    return keys;
+}
+
+int WideTree::height() const {
+    return levels;
+}
+
+void WideTree::makeEmpty() {
+    // Nodes hold no owned data, so the pool can go all at once.
+    root = nullptr;
+    keys = levels = 0;
+    pool.clear();
+}
+
+int WideTree::rank(const Node* n, int64_t target) {
+#if defined(__AVX2__)
+    // 4 lanes per compare; padding slots are INT64_MAX and never count.
+    __m256i t = _mm256_set1_epi64x(target);
+    int r = 0;
+    for (int i = 0; i < WIDTH; i += 4) {
+        __m256i k = _mm256_load_si256(
+            reinterpret_cast<const __m256i*>(n->keys + i));
+        __m256i lt = _mm256_cmpgt_epi64(t, k);
+        r += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(lt)));
+    }
+    return r;
+#elif defined(__SSE4_2__)
+    __m128i t = _mm_set1_epi64x(target);
+    int r = 0;
+    for (int i = 0; i < WIDTH; i += 2) {
+        __m128i k = _mm_load_si128(
+            reinterpret_cast<const __m128i*>(n->keys + i));
+        __m128i lt = _mm_cmpgt_epi64(t, k);
+        r += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(lt)));
+    }
+    return r;
+#else
+    int r = 0;
+    for (int i = 0; i < WIDTH; i++) {
+        r += (n->keys[i] < target);
+    }
+    return r;
+#endif
+}
+
+bool WideTree::retrieve(int64_t target) const {
+    const Node* n = root;
+    while (n != nullptr) {
+        int i = rank(n, target);
+        if (i < n->count && n->keys[i] == target) {
+            return true;
+        }
+        n = n->leaf ? nullptr : n->child[i];
+    }
+    return false;
+}
+
+bool WideTree::insert(int64_t key) {
+    if (root == nullptr) {
+        root = pool.allocate();
+        levels = 1;
+    } else if (root->count == MAX_KEYS) {
+        // grow upward: the old root becomes the only child of a new one.
+        Node* r = pool.allocate();
+        r->leaf = false;
+        r->child[0] = root;
+        root = r;
+        splitChild(root, 0);
+        levels++;
+    }
+
+    Node* n = root;
+    while (true) {
+        int i = rank(n, key);
+        if (i < n->count && n->keys[i] == key) {
+            return false;
+        }
+        if (n->leaf) {
+            // shift larger keys right, padding included, and drop key in.
+            for (int j = n->count; j > i; j--) {
+                n->keys[j] = n->keys[j - 1];
+            }
+            n->keys[i] = key;
+            n->count++;
+            keys++;
+            return true;
+        }
+        if (n->child[i]->count == MAX_KEYS) {
+            splitChild(n, i);
+            // the promoted median now sits at i; pick a side of it.
+            if (n->keys[i] == key) {
+                return false;
+            }
+            i += (n->keys[i] < key);
+        }
+        n = n->child[i];
+    }
+}
+
+void WideTree::splitChild(Node* parent, int i) {
+    Node* full = parent->child[i];
+    Node* right = pool.allocate();
+    const int mid = MAX_KEYS / 2;
+
+    // upper half of keys (and children) moves to the new right sibling.
+    right->leaf = full->leaf;
+    right->count = MAX_KEYS - mid - 1;
+    for (int j = 0; j < right->count; j++) {
+        right->keys[j] = full->keys[mid + 1 + j];
+        full->keys[mid + 1 + j] = INT64_MAX;
+    }
+    if (!full->leaf) {
+        for (int j = 0; j <= right->count; j++) {
+            right->child[j] = full->child[mid + 1 + j];
+            full->child[mid + 1 + j] = nullptr;
+        }
+    }
+    int64_t median = full->keys[mid];
+    full->keys[mid] = INT64_MAX;
+    full->count = mid;
+
+    // open a gap at i in parent for the median and the new child.
+    for (int j = parent->count; j > i; j--) {
+        parent->keys[j] = parent->keys[j - 1];
+        parent->child[j + 1] = parent->child[j];
+    }
+    parent->keys[i] = median;
+    parent->child[i + 1] = right;
+    parent->count++;
+}
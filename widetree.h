@@ -0,0 +1,137 @@
+/** ===========================================================================
+    widetree.h
+    Purpose: implement a B-tree of 64-bit integer keys with wide nodes.
+
+    Each Node holds up to 15 sorted keys in two cache lines, so one fetch
+    narrows the search 16 ways instead of 2 and the tree is about a quarter
+    as tall as a BinTree of the same size. The child to follow is found by
+    counting the keys smaller than the target with SIMD compares (AVX2 or
+    SSE4.2 when the compiler targets them, a plain loop otherwise).
+
+    Assumptions:
+    Duplicate keys are ignored when inserting into a tree.
+    Keys are int64_t. Unused key slots hold INT64_MAX so every compare can
+    run over the full width of a Node.
+    This class does not implement functions to remove individual keys.
+
+    @author: Charlie Nguyen
+    @version: 1.0
+---------------------------------------------------------------------------- */
+#ifndef WIDETREE_H
+#define WIDETREE_H
+
+#include "nodepool.h"
+#include <cstdint>
+#include <iostream>
+using namespace std;
+
+class WideTree
+{
+    // operator<< method can access WideTree class' private properties
+    friend ostream& operator<<(ostream& out, const WideTree& wt);
+public:
+    static const int WIDTH = 16;            // children per Node
+    static const int MAX_KEYS = WIDTH - 1;  // keys per Node
+
+    /** =======================================================================
+        Default constructor.
+        -------------------------------------------------------------------- */
+    WideTree();
+
+    /** =======================================================================
+        Destructor.
+        -------------------------------------------------------------------- */
+    ~WideTree();
+
+    // Copying is not supported.
+    WideTree(const WideTree&) = delete;
+    WideTree& operator=(const WideTree&) = delete;
+
+    /** =======================================================================
+        Checks to see if the tree is empty.
+
+        @return true if empty, false otherwise.
+        -------------------------------------------------------------------- */
+    bool isEmpty() const;
+
+    /** =======================================================================
+        @return the number of keys in the tree.
+        -------------------------------------------------------------------- */
+    int size() const;
+
+    /** =======================================================================
+        @return the number of Node levels in the tree, 0 if empty.
+        -------------------------------------------------------------------- */
+    int height() const;
+
+    /** =======================================================================
+        Returns every Node back to the pool, leaving the tree empty.
+        -------------------------------------------------------------------- */
+    void makeEmpty();
+
+    /** =======================================================================
+        Inserts a key, ignoring duplicates. Full Nodes met on the way down
+        are split first, so the insert never has to walk back up.
+
+        @param key The key to be inserted.
+        @return true if inserted, false if it was already present.
+        -------------------------------------------------------------------- */
+    bool insert(int64_t key);
+
+    /** =======================================================================
+        Checks whether the tree contains target.
+
+        @param target The key to search for.
+        @return true if found, false otherwise.
+        -------------------------------------------------------------------- */
+    bool retrieve(int64_t target) const;
+
+    /** =======================================================================
+        Prints the keys in ascending order, separated by spaces.
+
+        @param out The stream to be printed on.
+        -------------------------------------------------------------------- */
+    void inorder(ostream& out) const;
+
+private:
+    struct Node {
+        alignas(64) int64_t keys[WIDTH]; // sorted, padded with INT64_MAX
+        Node* child[WIDTH];              // child[i] holds keys < keys[i]
+        int count = 0;                   // keys in use
+        bool leaf = true;                // true if child[] is unused
+        Node();
+    };
+
+    Node* root = nullptr; // Root Node for entire WideTree
+    int keys = 0;         // number of keys in the tree
+    int levels = 0;       // height of the tree
+    NodePool<Node> pool;  // storage for every Node in this tree
+
+    /** =======================================================================
+        Counts the keys in a Node smaller than target, which is both the
+        position target would occupy and the index of the child to descend.
+
+        @param n The Node to search.
+        @param target The key to rank.
+        @return the number of keys in n less than target.
+        -------------------------------------------------------------------- */
+    static int rank(const Node* n, int64_t target);
+
+    /** =======================================================================
+        Splits the full child at index i of parent around its median, moving
+        the median up into parent. parent must not be full.
+
+        @param parent The Node whose child is split.
+        @param i The index of the full child.
+        -------------------------------------------------------------------- */
+    void splitChild(Node* parent, int i);
+
+    /** =======================================================================
+        Helper method that recursively prints a subtree in ascending order.
+
+        @param n The current Node.
+        @param out The output stream to print the tree to.
+        -------------------------------------------------------------------- */
+    void inorderHelper(const Node* n, ostream& out) const;
+};
+#endif